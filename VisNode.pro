@@ -1,5 +1,5 @@
 # Added by Mats:
-QT += core gui widgets qml xml
+QT += core gui widgets qml xml concurrent
 # Stop add.
 
 SOURCES += \
@@ -15,7 +15,24 @@ SOURCES += \
     cppnodeparser.cpp \
     abstractnodeitempositioncalc.cpp \
     circleshapepositioncalc.cpp \
-    distrshapepositioncalc.cpp
+    distrshapepositioncalc.cpp \
+    directivescanner.cpp \
+    benchmark.cpp \
+    filenamequeue.cpp \
+    directorywalker.cpp \
+    includeresolver.cpp \
+    compiledatabasereader.cpp \
+    parsecache.cpp \
+    filewatcher.cpp \
+    nodeindex.cpp \
+    nametable.cpp \
+    nodegraph.cpp \
+    nodearena.cpp \
+    forceshapepositioncalc.cpp \
+    forcekernel.cpp \
+    layershapepositioncalc.cpp \
+    multilevelshapepositioncalc.cpp \
+    stressshapepositioncalc.cpp
 
 HEADERS += \
     visnode.h \
@@ -29,4 +46,21 @@ HEADERS += \
     cppnodeparser.h \
     abstractnodeitempositioncalc.h \
     circleshapepositioncalc.h \
-    distrshapepositioncalc.h
+    distrshapepositioncalc.h \
+    directivescanner.h \
+    benchmark.h \
+    filenamequeue.h \
+    directorywalker.h \
+    includeresolver.h \
+    compiledatabasereader.h \
+    parsecache.h \
+    filewatcher.h \
+    nodeindex.h \
+    nametable.h \
+    nodegraph.h \
+    nodearena.h \
+    forceshapepositioncalc.h \
+    forcekernel.h \
+    layershapepositioncalc.h \
+    multilevelshapepositioncalc.h \
+    stressshapepositioncalc.h
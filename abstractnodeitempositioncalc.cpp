@@ -1,13 +1,83 @@
 #include "abstractnodeitempositioncalc.h"
-#include "nodeitem.h"
+#include "nodegraph.h"
+#include <QFuture>
+#include <QHash>
+#include <QPointF>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentRun>
+#include <qmath.h>
+#include <climits>              // INT_MIN, INT_MAX
+
+static const qreal PLACED_NODE_DISTANCE = 80.0;     // Distance from a placed node to its neighbours
+static const int RELAX_ITERATIONS = 20;
+static const int RELAX_MAX_NODES = 100;              // The most nodes moved by relaxNodes()
+static const int RELAX_MAX_NEIGHBOURS = 20;          // The most neighbours of a moved node taken into account
+static const qreal RELAX_NEIGHBOUR_SHARE = 0.25;     // How far the neighbours may move, compared to the relaxed nodes
+static const qreal RELAX_COOLING = 0.9;              // The largest move allowed shrinks by this every iteration
+static const qreal RELAX_MIN_DISTANCE = 0.01;        // Nodes closer than this are pushed as if this far apart
+static const int SHAPE_WIDTH_MOD = 100;             // Space around the node map
+static const int SHAPE_HEIGHT_MOD = 100;
+
+const qreal AbstractNodeItemPositionCalc::GOLDEN_ANGLE = 2.39996323;
+
+/*
+ *  Returns the number of nodes connected with the node in [row], see neighbourRow()
+ */
+static int neighbourCount(const NodeGraph& graph, int row)
+{
+    return graph.parentCount(row) + graph.childCount(row);
+}
+
+/*
+ *  Returns the row of the [index]th node connected with the node in [row], counting its
+ *  parents and then its children
+ */
+static int neighbourRow(const NodeGraph& graph, int row, int index)
+{
+    if (index < graph.parentCount(row))
+        return graph.parentRow(graph.parentBegin(row) + index);
+
+    return graph.childRow(graph.childBegin(row) + index - graph.parentCount(row));
+}
+
+/*
+ *  Returns the index of the [sample]th of the neighbours of the node in [row] taken into account
+ *  by relaxNodes(). A node with more than RELAX_MAX_NEIGHBOURS neighbours has them sampled evenly.
+ */
+static int sampledNeighbour(const NodeGraph& graph, int row, int sample)
+{
+    const int count = neighbourCount(graph, row);
+
+    return count <= RELAX_MAX_NEIGHBOURS ? sample : static_cast<int>(static_cast<qint64>(sample) * count / RELAX_MAX_NEIGHBOURS);
+}
 
 /*
  *  Constructor
  */
-AbstractNodeItemPositionCalc::AbstractNodeItemPositionCalc(QList<NodeItem*>& nodelist)
-    : _nodelist(nodelist), _centerPoint(QPoint(0,0))
+AbstractNodeItemPositionCalc::AbstractNodeItemPositionCalc()
+    : _graph(NULL), _centerPoint(QPoint(0,0)), _taskCount(0), _canceled(0), _snapshotInterval(0), _snapshotTaken(true)
+{
+    _threadPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+/*
+ *  Sets the graph whose node positions are calculated. The calculator reads the nodes and
+ *  edges from it and writes the positions to it, but doesn't own it.
+ */
+void AbstractNodeItemPositionCalc::setGraph(NodeGraph* graph)
 {
+    _graph = graph;
+}
 
+/*
+ *  Sets the number of threads the calculation may run on (default one per core), see
+ *  runTasks(). The layout is the same whatever the number.
+ */
+void AbstractNodeItemPositionCalc::setThreadCount(int threads)
+{
+    _threadPool.setMaxThreadCount(qMax(1, threads));
 }
 
 /*
@@ -29,13 +99,13 @@ void AbstractNodeItemPositionCalc::moveInto(const QPoint &newCenterPoint)
 
     QPoint temppoint;
 
-    for (int i = 0; i < _nodelist.size(); ++i) {    // Move all points to their new position
-        temppoint = _nodelist[i]->position();
+    for (int i = 0; i < _graph->nodeCount(); ++i) {    // Move all points to their new position
+        temppoint = _graph->position(i);
 
         temppoint.rx() += diffCenterPoint.x();
         temppoint.ry() += diffCenterPoint.y();
 
-        _nodelist[i]->setPosition(temppoint);
+        _graph->setPosition(i, temppoint);
     }
 
     _centerPoint = newCenterPoint;              // Save the new center point
@@ -62,13 +132,13 @@ void AbstractNodeItemPositionCalc::scaleTo(const QSize &sizeToFit)
 
     QPoint temppoint;
 
-    for (int i = 0; i < _nodelist.size(); ++i) {    // Scale all coords
-        temppoint = _nodelist[i]->position();
+    for (int i = 0; i < _graph->nodeCount(); ++i) {    // Scale all coords
+        temppoint = _graph->position(i);
 
         temppoint.rx() *= xRatio;
         temppoint.ry() *= yRatio;
 
-        _nodelist[i]->setPosition(temppoint);
+        _graph->setPosition(i, temppoint);
     }
 
     moveInto(originalCenterPoint);              // Move all coords back
@@ -81,5 +151,428 @@ const QSize &AbstractNodeItemPositionCalc::modelGeometricSize() const
 }
 
 
+/*
+ *  Asks a running calculation to stop as soon as it can, placing the nodes where they are
+ *  at that point. Cleared again before the next calculation.
+ */
+void AbstractNodeItemPositionCalc::setCanceled(bool canceled)
+{
+    _canceled.store(canceled ? 1 : 0);
+}
+
+
+/*
+ *  Returns true if the calculation is asked to stop
+ */
+bool AbstractNodeItemPositionCalc::isCanceled() const
+{
+    return _canceled.load() != 0;
+}
+
+
+/*
+ *  Sets how many iterations apart the calculation publishes the positions so far,
+ *  0 (the default) for not at all
+ */
+void AbstractNodeItemPositionCalc::setSnapshotInterval(int iterations)
+{
+    _snapshotInterval = qMax(0, iterations);
+}
+
 
+/*
+ *  Sets [positions] to the latest published positions, by row and centered around the origin.
+ *  Returns false, leaving [positions] as they are, if none were published since the last call.
+ */
+bool AbstractNodeItemPositionCalc::takeSnapshot(QVector<QPoint>& positions)
+{
+    QMutexLocker locker(&_snapshotMutex);
 
+    if (_snapshotTaken)
+        return false;
+
+    positions.swap(_snapshot);
+    _snapshotTaken = true;
+    return true;
+}
+
+
+/*
+ *  Returns true if the positions should be published before [iteration]
+ */
+bool AbstractNodeItemPositionCalc::snapshotDue(int iteration) const
+{
+    return _snapshotInterval > 0 && iteration % _snapshotInterval == 0;
+}
+
+
+/*
+ *  Publishes [positions] for takeSnapshot(), replacing any not taken yet
+ */
+void AbstractNodeItemPositionCalc::publishSnapshot(const QVector<QPoint>& positions)
+{
+    QMutexLocker locker(&_snapshotMutex);
+
+    _snapshot = positions;
+    _snapshotTaken = false;
+}
+
+
+/*
+ *  Collects the connected nodes of each node by row, its children and then its parents, into
+ *  [neighbours], with the ones of each row starting at [offsets] (CSR style, with one offset
+ *  more than rows). A node including itself isn't its own neighbour.
+ */
+void AbstractNodeItemPositionCalc::collectNeighbours(QVector<int>& offsets, QVector<int>& neighbours) const
+{
+    const int count = _graph->nodeCount();
+
+    offsets.resize(count + 1);
+    neighbours.clear();
+
+    for (int row = 0; row < count; ++row) {
+        offsets[row] = neighbours.size();
+
+        for (int edge = _graph->childBegin(row); edge < _graph->childEnd(row); ++edge) {
+            if (_graph->childRow(edge) != row)
+                neighbours.append(_graph->childRow(edge));
+        }
+
+        for (int edge = _graph->parentBegin(row); edge < _graph->parentEnd(row); ++edge) {
+            if (_graph->parentRow(edge) != row)
+                neighbours.append(_graph->parentRow(edge));
+        }
+    }
+
+    offsets[count] = neighbours.size();
+}
+
+
+/*
+ *  Runs runTask() for the tasks 0 to [tasks] - 1, on the threads of the pool and this one.
+ *  A thread done with its task takes the next one left, so a thread with slow tasks doesn't
+ *  hold the others up. Returns when all tasks are done.
+ */
+void AbstractNodeItemPositionCalc::runTasks(int tasks)
+{
+    const int helpers = qMin(_threadPool.maxThreadCount(), tasks) - 1;
+    QList<QFuture<void> > running;
+
+    _taskCount = tasks;
+    _nextTask.store(0);
+
+    for (int i = 0; i < helpers; ++i) {
+        running.append(QtConcurrent::run(&_threadPool, this, &AbstractNodeItemPositionCalc::runNextTasks));
+    }
+
+    runNextTasks();
+
+    foreach (QFuture<void> future, running) {
+        future.waitForFinished();
+    }
+}
+
+
+/*
+ *  Runs the tasks not yet taken by any thread, until there are none left
+ */
+void AbstractNodeItemPositionCalc::runNextTasks()
+{
+    forever {
+        const int task = _nextTask.fetchAndAddRelaxed(1);
+
+        if (task >= _taskCount)
+            return;
+
+        runTask(task);
+    }
+}
+
+
+/*
+ *  Does task [task] of runTasks(), called on any of the threads. The calculators using
+ *  runTasks() reimplement it, each task must only write what no other task reads or writes.
+ */
+void AbstractNodeItemPositionCalc::runTask(int task)
+{
+    Q_UNUSED(task);
+}
+
+
+/*
+ *  Places the nodes in [rows] (e.g. nodes added after the calculation) close to the nodes they
+ *  are connected with, without moving any other node. A node without placed neighbours is put
+ *  to the right of the current size, which extendSize() then grows to take it in.
+ */
+void AbstractNodeItemPositionCalc::placeNodes(const QList<int>& rows)
+{
+    if (rows.isEmpty())
+        return;
+
+    QSet<int> unplaced = QSet<int>::fromList(rows);
+    int placedAlone = 0;
+
+    for (int i = 0; i < rows.size(); ++i) {
+        const int row = rows.at(i);
+        QPointF center;
+        int placedNeighbours = 0;
+
+        for (int j = 0; j < neighbourCount(*_graph, row); ++j) {
+            const int neighbour = neighbourRow(*_graph, row, j);
+
+            if (!unplaced.contains(neighbour)) {
+                center += _graph->position(neighbour);
+                ++placedNeighbours;
+            }
+        }
+
+        if (placedNeighbours > 0) {
+            center /= placedNeighbours;
+        }
+        else {
+            center = QPointF(_centerPoint.x() + _currentSize.width() / 2 + PLACED_NODE_DISTANCE,
+                             _centerPoint.y() - _currentSize.height() / 2 + (placedAlone + 1) * PLACED_NODE_DISTANCE);
+            ++placedAlone;
+        }
+
+        // Go around the center point, so the nodes placed around the same point don't overlap
+        const qreal angle = i * GOLDEN_ANGLE;
+        _graph->setPosition(row, QPoint(qRound(center.x() + PLACED_NODE_DISTANCE * qCos(angle)),
+                                        qRound(center.y() + PLACED_NODE_DISTANCE * qSin(angle))));
+
+        unplaced.remove(row);
+    }
+}
+
+
+/*
+ *  Grows the current size to the right and downwards to take in the nodes in [rows] (e.g. the
+ *  nodes placed with placeNodes()) with the same space around them as calculateCurrentSize()
+ *  leaves. The other nodes aren't moved, so the top left corner stays where it is, and the center
+ *  point moves with the middle. Returns true if the size changed.
+ */
+bool AbstractNodeItemPositionCalc::extendSize(const QList<int>& rows)
+{
+    const int left = _centerPoint.x() - _currentSize.width() / 2;
+    const int top = _centerPoint.y() - _currentSize.height() / 2;
+    int right = left + _currentSize.width();
+    int bottom = top + _currentSize.height();
+
+    foreach (int row, rows) {
+        right = qMax(right, _graph->position(row).x() + SHAPE_WIDTH_MOD);
+        bottom = qMax(bottom, _graph->position(row).y() + SHAPE_HEIGHT_MOD);
+    }
+
+    const QSize size(right - left, bottom - top);
+
+    if (size == _currentSize)
+        return false;
+
+    _currentSize = size;
+    _centerPoint = QPoint(left + size.width() / 2, top + size.height() / 2);
+
+    return true;
+}
+
+
+/*
+ *  Refines the positions of the nodes in [rows] (e.g. nodes just added and placed with
+ *  placeNodes(), or nodes whose edges changed) with a few iterations of a force-directed
+ *  layout of their own: the nodes near each other push apart, and connected nodes pull together.
+ *
+ *  The nodes move up to a node distance in an iteration. Their neighbours were at rest before,
+ *  so they only move by how much the forces on them change from the start, and a quarter as
+ *  far. Pinned nodes never move. The nodes connected to the moved ones stay where they are,
+ *  but push and pull as well. Of a node with many neighbours (e.g. a header included everywhere)
+ *  only RELAX_MAX_NEIGHBOURS are taken into account, spread evenly over them, each pulling for
+ *  the ones left out. So the work is bounded by RELAX_MAX_NODES moved nodes with as many
+ *  neighbours each, whatever the size of the graph or the number of edges of the nodes.
+ *  Returns the rows of the moved nodes.
+ */
+QList<int> AbstractNodeItemPositionCalc::relaxNodes(const QList<int>& rows)
+{
+    QList<int> involved;                    // The rows of the moved nodes first, then the ones staying
+    QHash<int, int> localRows;              // The index of each node in involved, by row
+    QVector<QPointF> positions;
+    QVector<qreal> temperatures;            // The longest move allowed for each moved node
+    int freeNodes = 0;                      // The moved nodes of [rows], the first ones
+
+    // [rows] first, then their neighbours, so the limit cuts off neighbours first
+    for (int pass = 0; pass < 2; ++pass) {
+        const qreal temperature = PLACED_NODE_DISTANCE * (pass == 0 ? 1.0 : RELAX_NEIGHBOUR_SHARE);
+
+        for (int i = 0; i < rows.size() && involved.size() < RELAX_MAX_NODES; ++i) {
+            const int row = rows.at(i);
+            const int groupSize = pass == 0 ? 1 : qMin(neighbourCount(*_graph, row), RELAX_MAX_NEIGHBOURS);
+
+            for (int j = 0; j < groupSize && involved.size() < RELAX_MAX_NODES; ++j) {
+                const int member = pass == 0 ? row : neighbourRow(*_graph, row, sampledNeighbour(*_graph, row, j));
+
+                if (_graph->isPinned(member) || localRows.contains(member))
+                    continue;
+
+                localRows.insert(member, involved.size());
+                involved.append(member);
+                positions.append(_graph->position(member));
+                temperatures.append(temperature);
+            }
+        }
+
+        if (pass == 0)
+            freeNodes = involved.size();
+    }
+
+    const int moved = involved.size();
+
+    // The connected nodes by index, CSR style, adding the ones staying where they are
+    QVector<int> neighbourOffsets(moved + 1);
+    QVector<int> neighbours;
+    QVector<qreal> neighbourWeights;        // The number of neighbours each one pulls for
+
+    for (int i = 0; i < moved; ++i) {
+        const int row = involved.at(i);
+        const int count = neighbourCount(*_graph, row);
+        const int samples = qMin(count, RELAX_MAX_NEIGHBOURS);
+
+        neighbourOffsets[i] = neighbours.size();
+
+        for (int j = 0; j < samples; ++j) {
+            const int neighbour = neighbourRow(*_graph, row, sampledNeighbour(*_graph, row, j));
+
+            if (neighbour == row)
+                continue;
+
+            if (!localRows.contains(neighbour)) {
+                localRows.insert(neighbour, involved.size());
+                involved.append(neighbour);
+                positions.append(_graph->position(neighbour));
+            }
+
+            neighbours.append(localRows.value(neighbour));
+            neighbourWeights.append(static_cast<qreal>(count) / samples);
+        }
+    }
+
+    neighbourOffsets[moved] = neighbours.size();
+
+    // Also the nodes of [rows] that are pinned (or past the limit) push the moved ones, even without an edge
+    for (int i = 0; i < rows.size() && i < RELAX_MAX_NODES; ++i) {
+        const int row = rows.at(i);
+
+        if (!localRows.contains(row)) {
+            localRows.insert(row, involved.size());
+            involved.append(row);
+            positions.append(_graph->position(row));
+        }
+    }
+
+    const qreal k = PLACED_NODE_DISTANCE;
+    QVector<QPointF> forces(moved);
+    QVector<QPointF> startForces(moved);    // The forces on the neighbours before anything moved
+
+    for (int iteration = 0; iteration < RELAX_ITERATIONS; ++iteration) {
+        for (int i = 0; i < moved; ++i) {
+            QPointF force;
+
+            for (int j = 0; j < involved.size(); ++j) {
+                if (j == i)
+                    continue;
+
+                const QPointF delta = positions.at(i) - positions.at(j);
+                const qreal distance = qMax(qSqrt(delta.x() * delta.x() + delta.y() * delta.y()), RELAX_MIN_DISTANCE);
+
+                // Nodes at the same spot are pushed apart in a direction of their own
+                if (distance == RELAX_MIN_DISTANCE) {
+                    const qreal angle = qMin(i, j) * GOLDEN_ANGLE + (i < j ? 0.0 : M_PI);
+                    force += QPointF(qCos(angle), qSin(angle)) * (k * k / distance);
+                }
+                else {
+                    force += delta / distance * (k * k / distance);
+                }
+            }
+
+            for (int edge = neighbourOffsets.at(i); edge < neighbourOffsets.at(i + 1); ++edge) {
+                const QPointF delta = positions.at(i) - positions.at(neighbours.at(edge));
+                const qreal distance = qSqrt(delta.x() * delta.x() + delta.y() * delta.y());
+
+                force -= delta * (distance / k * neighbourWeights.at(edge));
+            }
+
+            forces[i] = force;
+        }
+
+        if (iteration == 0) {
+            for (int i = freeNodes; i < moved; ++i) {
+                startForces[i] = forces.at(i);
+            }
+        }
+
+        // All forces are found before any node is moved
+        for (int i = 0; i < moved; ++i) {
+            const QPointF force = forces.at(i) - startForces.at(i);
+            const qreal length = qSqrt(force.x() * force.x() + force.y() * force.y());
+
+            if (length > 0.0)
+                positions[i] += force / length * qMin(length, temperatures.at(i));
+
+            temperatures[i] *= RELAX_COOLING;
+        }
+    }
+
+    for (int i = 0; i < moved; ++i) {
+        _graph->setPosition(involved.at(i), positions.at(i).toPoint());
+    }
+
+    return involved.mid(0, moved);
+}
+
+
+/*
+ *  Calculates the width and height of the model by looking at
+ *  the positions of all the nodes, finding the outermost ones.
+ *  Adds a bit space around it determined by SHAPE_WIDTH_MOD
+ *  and SHAPE_HEIGHT_MOD. Used by the calculators after placing all nodes.
+ */
+void AbstractNodeItemPositionCalc::calculateCurrentSize()
+{
+    if (_graph->nodeCount() == 0)
+        return;
+
+    // Store some default, always to be over-written values
+    int maxX = INT_MIN, minX = INT_MAX,
+        maxY = INT_MIN, minY = INT_MAX;
+
+    // Look at each node's position and modify the max/min values if greater/lesser
+    for (int row = 0; row < _graph->nodeCount(); ++row) {
+        QPoint nodepos = _graph->position(row);
+
+        if (nodepos.x() > maxX)
+            maxX = nodepos.x();
+        if (nodepos.x() < minX)
+            minX = nodepos.x();
+        if (nodepos.y() > maxY)
+            maxY = nodepos.y();
+        if (nodepos.y() < minY)
+            minY = nodepos.y();
+    }
+
+    // Add some extra space around the "node map"
+    minX -= SHAPE_WIDTH_MOD;
+    maxX += SHAPE_WIDTH_MOD;
+    minY -= SHAPE_HEIGHT_MOD;
+    maxY += SHAPE_HEIGHT_MOD;
+
+    int width = (maxX - minX);
+    int height = (maxY - minY);
+
+    QSize newSize(width, height);
+
+    // As the "node map" won't be perfectly centered at the origin, calculate a new center point
+    QPoint newCenter(minX + (width / 2), minY + (height / 2));
+
+    _currentSize = newSize;
+    _centerPoint = newCenter;
+
+    // Move the "node map" to center around the weighted center
+    moveInto(_centerPoint);
+}
@@ -3,7 +3,18 @@
  *
  * This class is the abstract base class for calculating the position of the nodes
  * to be represented graphically in the view.
- * It is a part of the NodeItemModel.
+ * It is a part of the NodeItemModel, and works on the NodeGraph the model sets, see setGraph().
+ *
+ * The calculation may run on a thread of its own (see NodeItemModel::startLayout()). The
+ * calculators iterating towards their layout then publish a snapshot of the positions every
+ * few iterations for the model to show, and stop early when canceled, still leaving every
+ * node placed.
+ *
+ * Once calculated, nodes added or changed later are placed and refined locally, see
+ * placeNodes() and relaxNodes(), leaving the rest of the map as it is.
+ *
+ * The calculators working in parallel hand their work out with runTasks(), to a pool of
+ * threads of their own, see setThreadCount().
  *
  * Mats Adborn, 2013-05-12
  */
@@ -11,27 +22,63 @@
 #ifndef ABSTRACTNODEITEMPOSITIONCALC_H
 #define ABSTRACTNODEITEMPOSITIONCALC_H
 
+#include <QAtomicInt>
 #include <QList>
+#include <QMutex>
 #include <QPoint>
 #include <QSize>
+#include <QThreadPool>
+#include <QVector>
 
-class NodeItem;
+class NodeGraph;
 
 class AbstractNodeItemPositionCalc
 {
 public:
-    AbstractNodeItemPositionCalc(QList<NodeItem*>& nodelist);
+    AbstractNodeItemPositionCalc();
     virtual ~AbstractNodeItemPositionCalc() {}
 
+    void setGraph(NodeGraph* graph);
     virtual void calculate() = 0;
+    void placeNodes(const QList<int>& rows);
+    QList<int> relaxNodes(const QList<int>& rows);
+    bool extendSize(const QList<int>& rows);
     void moveInto(const QPoint& newCenterPoint);
     void scaleTo(const QSize& sizeToFit);
     const QSize& modelGeometricSize() const;
+    void setThreadCount(int threads);
+
+    // Thread safe, for the thread waiting for a calculation on another one
+    void setCanceled(bool canceled);
+    bool isCanceled() const;
+    void setSnapshotInterval(int iterations);
+    bool takeSnapshot(QVector<QPoint>& positions);
 
 protected:
-    QList<NodeItem*>& _nodelist;
+    static const qreal GOLDEN_ANGLE;    // Spreads nodes evenly around a point, however many there are
+
+    void calculateCurrentSize();
+    bool snapshotDue(int iteration) const;
+    void publishSnapshot(const QVector<QPoint>& positions);
+    void collectNeighbours(QVector<int>& offsets, QVector<int>& neighbours) const;
+    void runTasks(int tasks);
+    virtual void runTask(int task);
+
+    NodeGraph* _graph;
     QPoint _centerPoint;
     QSize _currentSize;
+
+private:
+    void runNextTasks();
+
+    QThreadPool _threadPool;
+    QAtomicInt _nextTask;               // The next task of runTasks() for a thread to take
+    int _taskCount;
+    QAtomicInt _canceled;
+    int _snapshotInterval;              // Iterations between the snapshots, 0 for none
+    QMutex _snapshotMutex;              // Guards the two below
+    QVector<QPoint> _snapshot;          // The latest published positions, by row
+    bool _snapshotTaken;
 };
 
 
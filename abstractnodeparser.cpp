@@ -1,15 +1,23 @@
 #include "abstractnodeparser.h"
+#include "parsecache.h"
 #include <QFile>
 #include <QStringList>
+#include <QFileInfo>
+#include <QQueue>
+#include <QFuture>
+#include <QtConcurrentRun>
 
+// Number of files that may be queued for parsing per worker thread, ahead of the merge
+static const int PENDING_FILES_PER_JOB = 4;
 
 /*
  *  Constructor
  */
-AbstractNodeParser::AbstractNodeParser(QList<NodeItem*>& nodeList)
-    : _nodelist(nodeList)
+AbstractNodeParser::AbstractNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena)
+    : _nodelist(nodeList), _currentContext(0), _jobs(1), _cache(NULL), _followFoundFiles(false),
+      _recordParsedFiles(false)
 {
-    _nodeCreator = new NodeCreator(nodeList);
+    _nodeCreator = new NodeCreator(nodeList, nodeIndex, nodeArena);
 }
 
 
@@ -23,12 +31,16 @@ AbstractNodeParser::~AbstractNodeParser()
 
 
 /*
- *  Opens a file and calls the subclass specific processFile() on it
+ *  Opens a file and calls the subclass specific processFile() on it.
+ *  The [context] is a subclass specific id of how to parse the file, available
+ *  to processFile() through currentContext(). The default context is 0.
  */
-bool AbstractNodeParser::parseFile(const QString& fileName)
+bool AbstractNodeParser::parseFile(const QString& fileName, int context)
 {    
     QFile file(fileName);
 
+    _currentContext = context;
+
     if (!file.open(QFile::ReadOnly | QFile::Text)) {
         std::cerr << "AbstractNodeParser::readFile(): Failed to open file " << qPrintable(fileName) << std::endl;
         return false;
@@ -51,15 +63,423 @@ bool AbstractNodeParser::parseFile(const QString& fileName)
  */
 bool AbstractNodeParser::parseFiles(const QStringList& fileNames)
 {
-    for (int i = 0; i < fileNames.size(); i++) {
-        if (!parseFile(fileNames.at(i)))
+    FileNameQueue queue;
+
+    foreach (const QString& fileName, fileNames) {
+        queue.enqueue(fileName);
+    }
+
+    queue.close();
+
+    return parseFiles(queue);
+}
+
+
+/*
+ *  Parses the files in the queue until it's closed and empty, while other threads
+ *  (e.g. a DirectoryWalker) may still be adding files to it.
+ *  Returns true if all files were read without problem, otherwise false.
+ *  On failure the queue is closed, to tell the producers to stop.
+ *  If more than one job is set, the files are parsed in parallel (see parseFilesParallel()).
+ *  With a cache or recording, the files are parsed the same way even with one job, as the cached
+ *  and recorded results are separate node lists per file.
+ */
+bool AbstractNodeParser::parseFiles(FileNameQueue& queue)
+{
+    if (_jobs > 1 || _cache != NULL || _recordParsedFiles)
+        return parseFilesParallel(queue);
+
+    QString fileName;
+    int context;
+
+    while (takeNextFile(queue, true, fileName, context)) {
+        if (!parseFile(fileName, context)) {
+            queue.close();
             return false;
+        }
+
+        followFoundFiles(_foundFiles, context);
+        _foundFiles.clear();
+    }
+
+    return true;
+}
+
+
+/*
+ *  Parses the files on the worker pool, each file into a node list of its own.
+ *  The results are merged into the shared node list strictly in the order the files were taken
+ *  (see takeNextFile()), which makes the merged nodes and edges identical to those of a
+ *  sequential run, regardless of the number of threads used.
+ */
+bool AbstractNodeParser::parseFilesParallel(FileNameQueue& queue)
+{
+    QQueue<QFuture<ParseResult> > pending;
+    const int maxPending = _jobs * PENDING_FILES_PER_JOB;
+    QQueue<FileInContext> pendingFiles;
+    QString fileName;
+    int context;
+    bool ok = true;
+    NodeChanges changes;                // Not needed, the results are merged as they are
+
+    forever {
+        // Keep the workers busy, but don't let them run too far ahead of the merge.
+        // Only wait for new files when there's nothing else to do.
+        while (ok && pending.size() < maxPending &&
+               takeNextFile(queue, pending.isEmpty(), fileName, context)) {
+            pending.enqueue(QtConcurrent::run(&_threadPool, this, &AbstractNodeParser::parseFileIsolated, fileName, context));
+            pendingFiles.enqueue(FileInContext(fileName, context));
+        }
+
+        if (pending.isEmpty())
+            break;
+
+        // Wait for the oldest file, to merge the results in file order
+        ParseResult result = pending.dequeue().result();
+        const FileInContext file = pendingFiles.dequeue();
+
+        // After a failure the remaining results are only dropped, like the sequential run stops at the first failing file
+        if (ok && result.ok) {
+            _nodeCreator->mergeNodes(result.nodes);
+            followFoundFiles(result.foundFiles, file.second);
+
+            if (_recordParsedFiles)
+                recordFile(file, result.nodes, changes);
+        }
+        else if (ok) {
+            ok = false;
+            queue.close();
+        }
+    }
+
+    return ok;
+}
+
+
+/*
+ *  Parses a single file into a node list of its own, using a new parser of the same kind.
+ *  If the file is unchanged since it was cached, the cached result is used instead.
+ *  Called from the worker threads, so it mustn't touch the shared node list.
+ */
+AbstractNodeParser::ParseResult AbstractNodeParser::parseFileIsolated(const QString& fileName, int context) const
+{
+    ParseResult result;
+    ParseCache::FileStamp stamp;
+
+    if (_cache != NULL && _cache->lookup(fileName, contextFlags(context), stamp, *result.nodeArena, result.nodes, result.foundFiles)) {
+        result.ok = true;
+        return result;
+    }
+
+    AbstractNodeParser* worker = createWorkerParser(result.nodes, result.nodeIndex, *result.nodeArena);
+    result.ok = worker->parseFile(fileName, context);
+    result.foundFiles = worker->_foundFiles;
+    delete worker;
+
+    if (_cache != NULL && result.ok)
+        _cache->store(fileName, contextFlags(context), stamp, result.nodes, result.foundFiles);
+
+    return result;
+}
+
+
+/*
+ *  Takes the next file to parse, and its context. The files in the queue go first, and when it's
+ *  closed and empty the files found while parsing are taken (if following them is enabled, see
+ *  followFoundFiles()). Keeping that order, and only marking files as visited when they are taken,
+ *  makes the order of the files the same on every run. Files already visited in the same context
+ *  are skipped, so each file is parsed once per context.
+ *  If [wait] is false, false is returned when no file is available right now. Otherwise, false
+ *  is only returned when there are no files left at all.
+ */
+bool AbstractNodeParser::takeNextFile(FileNameQueue& queue, bool wait, QString& fileName, int& context)
+{
+    while (wait ? queue.dequeue(fileName, &context) : queue.tryDequeue(fileName, &context)) {
+        if (markVisited(fileName, context))
+            return true;
     }
 
+    // The queue isn't done yet, the found files have to wait until it is
+    if (!queue.isFinished())
+        return false;
+
+    while (!_filesToFollow.isEmpty()) {
+        FileInContext file = _filesToFollow.dequeue();
+        fileName = file.first;
+        context = file.second;
+
+        if (markVisited(fileName, context))
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ *  Marks a file as visited in a context, so that it's parsed only once per context
+ *  (e.g. when it's both given and found, or listed twice in a compilation database).
+ *  Returns false if the file has already been visited.
+ */
+bool AbstractNodeParser::markVisited(const QString& fileName, int context)
+{
+    // Use the canonical path, the same file may be named in different ways
+    QString canonical = QFileInfo(fileName).canonicalFilePath();
+
+    if (canonical.isEmpty())
+        canonical = fileName;
+
+    FileInContext file(canonical, context);
+
+    if (_visitedFiles.contains(file))
+        return false;
+
+    _visitedFiles.insert(file);
+
     return true;
 }
 
 
+/*
+ *  Queues the files found while parsing a file (see addFoundFile()) to be parsed as well,
+ *  if following found files is enabled. The found files are parsed in the same [context]
+ *  as the file they were found in. Each file is only queued once per context.
+ */
+void AbstractNodeParser::followFoundFiles(const QStringList& fileNames, int context)
+{
+    if (!_followFoundFiles)
+        return;
+
+    foreach (const QString& fileName, fileNames) {
+        FileInContext file(fileName, context);
+
+        if (!_queuedFoundFiles.contains(file)) {
+            _queuedFoundFiles.insert(file);
+            _filesToFollow.enqueue(file);
+        }
+    }
+}
+
+
+/*
+ *  Records the nodes and edges [nodes] gives for [file], replacing its earlier record, and
+ *  counts how many files give each node, and how many times each edge is given. The nodes and
+ *  edges no file gave before are added to [changes], as are those no file gives any more, and
+ *  the edges given a different number of times than before.
+ */
+void AbstractNodeParser::recordFile(const FileInContext& file, const QList<NodeItem*>& nodes, NodeChanges& changes)
+{
+    FileRecord record;
+
+    foreach (NodeItem* node, nodes) {
+        record.nodes.append(node->nameId());
+
+        foreach (NodeItem* child, node->children()) {
+            record.edges.append(NodeChanges::Edge(node->nameId(), child->nameId()));
+            record.multiplicities.append(node->childMultiplicity(child));
+        }
+    }
+
+    if (!_fileRecords.contains(file))
+        _fileContexts.insert(file.first, file.second);
+
+    const FileRecord oldRecord = _fileRecords.value(file);
+    _fileRecords.insert(file, record);
+
+    // Count the new record first, so that the nodes and edges in both records are never removed
+    for (int i = 0; i < record.nodes.size(); ++i) {
+        if (_nodeRefs[record.nodes.at(i)]++ == 0)
+            changes.addedNodes.append(qMakePair(record.nodes.at(i), nodes.at(i)->color()));
+    }
+
+    // The edges of either record, with the times they were given before
+    QList<NodeChanges::Edge> edges;
+    QHash<NodeChanges::Edge, int> oldMultiplicities;
+
+    for (int i = 0; i < record.edges.size(); ++i) {
+        const NodeChanges::Edge& edge = record.edges.at(i);
+
+        if (!oldMultiplicities.contains(edge)) {
+            oldMultiplicities.insert(edge, _edgeRefs.value(edge));
+            edges.append(edge);
+        }
+
+        _edgeRefs[edge] += record.multiplicities.at(i);
+    }
+
+    for (int i = 0; i < oldRecord.edges.size(); ++i) {
+        const NodeChanges::Edge& edge = oldRecord.edges.at(i);
+
+        if (!oldMultiplicities.contains(edge)) {
+            oldMultiplicities.insert(edge, _edgeRefs.value(edge));
+            edges.append(edge);
+        }
+
+        _edgeRefs[edge] -= oldRecord.multiplicities.at(i);
+    }
+
+    foreach (const NodeChanges::Edge& edge, edges) {
+        const int oldMultiplicity = oldMultiplicities.value(edge);
+        const int multiplicity = _edgeRefs.value(edge);
+
+        if (multiplicity == 0) {
+            _edgeRefs.remove(edge);
+            changes.removedEdges.append(edge);
+        }
+        else if (oldMultiplicity == 0)
+            changes.addedEdges.append(qMakePair(edge, multiplicity));
+        else if (multiplicity != oldMultiplicity)
+            changes.changedEdges.append(qMakePair(edge, multiplicity));
+    }
+
+    foreach (quint32 nameId, oldRecord.nodes) {
+        if (--_nodeRefs[nameId] == 0) {
+            _nodeRefs.remove(nameId);
+            changes.removedNodes.append(nameId);
+        }
+    }
+}
+
+
+/*
+ *  Parses a file again after it has changed on disk (or been removed), in all contexts it was
+ *  parsed in, and adds the differences in nodes and edges since the last time to [changes].
+ *  The node list itself isn't changed, see NodeItemModel::applyChanges().
+ *  If following found files is enabled, the files it now includes are parsed as well.
+ *  Only files parsed while recording is enabled are known, false is returned for others.
+ */
+bool AbstractNodeParser::reparseFile(const QString& fileName, NodeChanges& changes)
+{
+    const QList<int> contexts = _fileContexts.values(fileName);
+
+    if (contexts.isEmpty())
+        return false;
+
+    QQueue<FileInContext> files;
+
+    foreach (int context, contexts) {
+        files.enqueue(FileInContext(fileName, context));
+    }
+
+    while (!files.isEmpty()) {
+        const FileInContext file = files.dequeue();
+        ParseResult result;
+
+        // A removed file gives no nodes, neither does one that can't be parsed any more
+        if (QFileInfo(file.first).exists())
+            result = parseFileIsolated(file.first, file.second);
+
+        if (!result.ok) {
+            result.nodes.clear();
+            result.foundFiles.clear();
+        }
+
+        recordFile(file, result.nodes, changes);
+
+        if (_followFoundFiles) {
+            foreach (const QString& foundName, result.foundFiles) {
+                const FileInContext foundFile(foundName, file.second);
+
+                if (!_fileRecords.contains(foundFile) && !files.contains(foundFile))
+                    files.enqueue(foundFile);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ *  Returns the names of the files parsed while recording was enabled
+ */
+QStringList AbstractNodeParser::parsedFiles() const
+{
+    return _fileContexts.uniqueKeys();
+}
+
+
+/*
+ *  Sets if the nodes and edges of each parsed file should be recorded, which is needed to
+ *  parse files again when they change (see reparseFile()). Disabled by default.
+ */
+void AbstractNodeParser::setRecordParsedFiles(bool record)
+{
+    _recordParsedFiles = record;
+}
+
+
+/*
+ *  Called by the subclasses' processFile() when a file that could be parsed as well is found,
+ *  e.g. an included header
+ */
+void AbstractNodeParser::addFoundFile(const QString& fileName)
+{
+    _foundFiles.append(fileName);
+}
+
+
+/*
+ *  Returns the context of the file being parsed, see parseFile()
+ */
+int AbstractNodeParser::currentContext() const
+{
+    return _currentContext;
+}
+
+
+/*
+ *  Returns a description of how files are parsed in [context], e.g. the compiler flags.
+ *  Cached parse results are only used for files parsed the same way (see setCache()).
+ *  The subclasses with contexts or options affecting the result must reimplement it.
+ */
+QString AbstractNodeParser::contextFlags(int context) const
+{
+    Q_UNUSED(context);
+    return QString();
+}
+
+
+/*
+ *  Sets a cache of parse results to use, so that files unchanged since they were cached aren't
+ *  parsed again. The cache isn't owned by the parser. NULL (the default) parses all files.
+ */
+void AbstractNodeParser::setCache(ParseCache* cache)
+{
+    _cache = cache;
+}
+
+
+/*
+ *  Sets if files found while parsing (e.g. included headers) should be parsed as well,
+ *  which gives the full closure of the files parsed. Disabled by default.
+ */
+void AbstractNodeParser::setFollowFoundFiles(bool follow)
+{
+    _followFoundFiles = follow;
+}
+
+
+/*
+ *  Sets the number of files to parse in parallel. One job (the default) parses
+ *  the files sequentially on the calling thread.
+ */
+void AbstractNodeParser::setJobCount(int jobs)
+{
+    _jobs = qMax(1, jobs);
+    _threadPool.setMaxThreadCount(_jobs);
+}
+
+
+/*
+ *  Returns the number of files parsed in parallel
+ */
+int AbstractNodeParser::jobCount() const
+{
+    return _jobs;
+}
+
+
 /*
  *  Returns the NodeCreator member
  */
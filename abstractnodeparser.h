@@ -11,29 +11,98 @@
 #define ABSTRACTNODEPARSER_H
 
 #include "nodecreator.h"
+#include "filenamequeue.h"
 #include <iostream>
+#include <QHash>
 #include <QList>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
 
 class QFile;
 class QString;
-class QStringList;
 class NodeItem;
+class ParseCache;
 
 class AbstractNodeParser
 {
 public:
-    AbstractNodeParser(QList<NodeItem*>& nodeList);
+    AbstractNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena);
     virtual ~AbstractNodeParser();
-    bool parseFile(const QString& fileName);
+    bool parseFile(const QString& fileName, int context = 0);
     bool parseFiles(const QStringList& fileNames);
+    bool parseFiles(FileNameQueue& queue);
+
+    void setJobCount(int jobs);
+    int jobCount() const;
+    void setFollowFoundFiles(bool follow);
+    void setCache(ParseCache* cache);
+    void setRecordParsedFiles(bool record);
+
+    QStringList parsedFiles() const;
+    bool reparseFile(const QString& fileName, NodeChanges& changes);
 
     NodeCreator* nodeCreator() const;
 
 protected:
     virtual bool processFile(QFile& file) = 0;
+    virtual AbstractNodeParser* createWorkerParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena) const = 0;
+    virtual QString contextFlags(int context) const;
+    void addFoundFile(const QString& fileName);
+    int currentContext() const;
 
     QList<NodeItem*>& _nodelist;
     NodeCreator* _nodeCreator;
+
+private:
+    typedef QPair<QString, int> FileInContext;
+
+    // The nodes found in a single file, parsed separately from the shared node list.
+    // The nodes are owned by the result's arena, which is freed with the last copy of the result.
+    struct ParseResult {
+        ParseResult() : ok(false), nodeArena(new NodeArena) {}
+        bool ok;
+        QSharedPointer<NodeArena> nodeArena;
+        QList<NodeItem*> nodes;
+        NodeIndex nodeIndex;
+        QStringList foundFiles;
+    };
+
+    // The nodes and edges a parsed file gave, to know what changes when it's parsed again
+    struct FileRecord {
+        QList<quint32> nodes;           // Name ids, see NameTable
+        QList<NodeChanges::Edge> edges;
+        QList<int> multiplicities;      // The times the file gives each edge
+    };
+
+    ParseResult parseFileIsolated(const QString& fileName, int context) const;
+    bool parseFilesParallel(FileNameQueue& queue);
+    bool takeNextFile(FileNameQueue& queue, bool wait, QString& fileName, int& context);
+    bool markVisited(const QString& fileName, int context);
+    void followFoundFiles(const QStringList& fileNames, int context);
+    void recordFile(const FileInContext& file, const QList<NodeItem*>& nodes, NodeChanges& changes);
+
+    int _currentContext;
+
+    int _jobs;
+    QThreadPool _threadPool;
+
+    ParseCache* _cache;
+
+    bool _followFoundFiles;
+    QStringList _foundFiles;                // Found by processFile() in the file being parsed
+    QQueue<FileInContext> _filesToFollow;   // Found files waiting to be parsed
+    QSet<FileInContext> _queuedFoundFiles;  // All found files queued so far
+    QSet<FileInContext> _visitedFiles;      // All files taken for parsing, by canonical path
+
+    bool _recordParsedFiles;
+    QHash<FileInContext, FileRecord> _fileRecords;
+    QMultiHash<QString, int> _fileContexts;         // The contexts each recorded file is parsed in
+    QHash<quint32, int> _nodeRefs;                  // The number of recorded files giving each node
+    QHash<NodeChanges::Edge, int> _edgeRefs;        // The times the recorded files give each edge, all added up
 };
 
 #endif // ABSTRACTNODEPARSER_H
@@ -0,0 +1,318 @@
+#include "benchmark.h"
+#include "directivescanner.h"
+#include "forcekernel.h"
+#include "forceshapepositioncalc.h"
+#include "nametable.h"
+#include "nodegraph.h"
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QRegularExpression>
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+#include <cstring>              // memcmp()
+#include <iostream>             // cout, cerr, endl
+
+static const int SCANNER_BENCH_SIZE = 16 * 1024 * 1024;    // The bytes of source scanned
+static const int SCANNER_BENCH_LINES_PER_INCLUDE = 40;
+static const char* const SCANNER_KERNELS[] = { "scalar", "sse2", "avx2" };
+static const int FORCE_BENCH_SIZES[] = { 10000, 50000 };   // The number of nodes of the graphs laid out
+static const int FORCE_BENCH_ITERATIONS = 20;
+static const int FORCE_BENCH_EXTRA_EDGES = 2;              // Edges per node besides the one to its parent
+static const char* const FORCE_INSTRUCTION_SETS[] = { "scalar", "sse2", "avx" };
+static const int KERNEL_BENCH_POINTS = 256;                // The points summed per call, about as many as a quadtree walk collects
+static const int KERNEL_BENCH_CALLS = 200000;
+
+/*
+ *  Returns the next number of a simple, fixed sequence, so every run times the same data
+ */
+static quint32 nextRandom(quint32& state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+/*
+ *  Runs all benchmarks, and returns the exit code of the program: 0 if all of them gave the
+ *  same results with all instruction sets, 1 otherwise
+ */
+int Benchmark::run()
+{
+    bool ok = benchDirectiveScanner();
+    ok = benchForceKernel() && ok;
+    ok = benchForceLayout() && ok;
+
+    return ok ? 0 : 1;
+}
+
+/*
+ *  Times finding the #include lines of generated C++ source with DirectiveScanner, using each
+ *  kernel the CPU runs, against reading it line by line and matching the lines with a regular
+ *  expression, as the parser first did. Prints the megabytes scanned per second for each.
+ *  Returns false if they don't find the same number of lines.
+ */
+bool Benchmark::benchDirectiveScanner()
+{
+    static const char INCLUDE[] = "#include";
+
+    const char* const selected = DirectiveScanner::kernelName();
+    const QByteArray source = generateSource(SCANNER_BENCH_SIZE);
+    const qreal megabytes = source.size() / (1024.0 * 1024.0);
+    bool ok = true;
+
+    std::cout << "Directive scanner, " << qRound(megabytes) << " MB of source (" << selected
+              << " picked for this CPU)" << std::endl;
+
+    // The lines read and matched one by one
+    QElapsedTimer timer;
+    timer.start();
+
+    QTextStream stream(source, QIODevice::ReadOnly);
+    QRegularExpression rxInclude("^#include");
+    int regexIncludes = 0;
+
+    while (!stream.atEnd()) {
+        if (rxInclude.match(stream.readLine().trimmed()).hasMatch())
+            ++regexIncludes;
+    }
+
+    const qreal regexRate = megabytes / (qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9);
+
+    std::cout << "  regular expression: " << QString::number(regexRate, 'f', 1).toStdString() << " MB/s, "
+              << regexIncludes << " includes" << std::endl;
+
+    for (unsigned int kernel = 0; kernel < sizeof(SCANNER_KERNELS) / sizeof(SCANNER_KERNELS[0]); ++kernel) {
+        if (!DirectiveScanner::setKernel(SCANNER_KERNELS[kernel]))
+            continue;
+
+        timer.start();
+
+        const char* const end = source.constData() + source.size();
+        DirectiveScanner scanner(source.constData(), end);
+        const char* hash = scanner.findNext(source.constData());
+        int includes = 0;
+
+        while (hash != NULL) {
+            if (end - hash >= static_cast<int>(sizeof(INCLUDE)) - 1 && memcmp(hash, INCLUDE, sizeof(INCLUDE) - 1) == 0)
+                ++includes;
+
+            hash = scanner.findNext(hash + 1);
+        }
+
+        const qreal rate = megabytes / (qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9);
+
+        std::cout << "  " << DirectiveScanner::kernelName() << ": " << QString::number(rate, 'f', 1).toStdString()
+                  << " MB/s (x" << QString::number(rate / regexRate, 'f', 1).toStdString() << "), "
+                  << includes << " includes";
+
+        if (includes != regexIncludes) {
+            std::cout << ", but not as many as the regular expression";
+            ok = false;
+        }
+
+        std::cout << std::endl;
+    }
+
+    DirectiveScanner::setKernel(selected);
+
+    return ok;
+}
+
+/*
+ *  Times ForceKernel::repulsion() alone with each instruction set the CPU runs, and prints the
+ *  points summed per second for each. Returns false if they don't give the same sums.
+ */
+bool Benchmark::benchForceKernel()
+{
+    const char* const selected = ForceKernel::instructionSet();
+    quint32 state = 1;
+    QVector<float> pointX(KERNEL_BENCH_POINTS), pointY(KERNEL_BENCH_POINTS), weight(KERNEL_BENCH_POINTS);
+    float scalarForceX = 0.0f, scalarForceY = 0.0f;
+    qreal scalarRate = 0.0;
+    bool ok = true;
+
+    for (int i = 0; i < KERNEL_BENCH_POINTS; ++i) {
+        pointX[i] = nextRandom(state) % 10000;
+        pointY[i] = nextRandom(state) % 10000;
+        weight[i] = 1 + nextRandom(state) % 16;
+    }
+
+    std::cout << "Force kernel, " << KERNEL_BENCH_POINTS << " points per call (" << selected
+              << " picked for this CPU)" << std::endl;
+
+    for (unsigned int set = 0; set < sizeof(FORCE_INSTRUCTION_SETS) / sizeof(FORCE_INSTRUCTION_SETS[0]); ++set) {
+        if (!ForceKernel::setInstructionSet(FORCE_INSTRUCTION_SETS[set]))
+            continue;
+
+        float forceX = 0.0f, forceY = 0.0f;
+        QElapsedTimer timer;
+        timer.start();
+
+        // The node moves a little every call, so the calls can't be folded into one
+        for (int call = 0; call < KERNEL_BENCH_CALLS; ++call) {
+            ForceKernel::repulsion(call % 10000, call % 7919, pointX.constData(), pointY.constData(), weight.constData(),
+                                   KERNEL_BENCH_POINTS, 0.0001f, forceX, forceY);
+        }
+
+        const qreal seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+        const qreal rate = static_cast<qreal>(KERNEL_BENCH_POINTS) * KERNEL_BENCH_CALLS / seconds;
+
+        std::cout << "  " << ForceKernel::instructionSet() << ": " << qRound64(rate) << " points/s";
+
+        if (set == 0) {
+            scalarForceX = forceX;
+            scalarForceY = forceY;
+            scalarRate = rate;
+        }
+        else {
+            std::cout << " (x" << QString::number(rate / scalarRate, 'f', 2).toStdString() << ")";
+
+            if (forceX != scalarForceX || forceY != scalarForceY) {
+                std::cout << ", but not the same sums as the scalar version";
+                ok = false;
+            }
+        }
+
+        std::cout << std::endl;
+    }
+
+    ForceKernel::setInstructionSet(selected);
+
+    return ok;
+}
+
+/*
+ *  Times the force layout on a single thread (see ForceShapePositionCalc) with each
+ *  instruction set of ForceKernel the CPU runs, and prints the nodes calculated per second
+ *  for each, an iteration calculating all nodes once. The layout runs a fixed number of
+ *  iterations without settling early, so the versions do the same work. Returns false if
+ *  they don't give the same layout.
+ */
+bool Benchmark::benchForceLayout()
+{
+    const char* const selected = ForceKernel::instructionSet();
+    bool ok = true;
+
+    std::cout << "Force layout, " << FORCE_BENCH_ITERATIONS << " iterations on 1 thread (" << selected
+              << " picked for this CPU)" << std::endl;
+
+    for (unsigned int size = 0; size < sizeof(FORCE_BENCH_SIZES) / sizeof(FORCE_BENCH_SIZES[0]); ++size) {
+        const int count = FORCE_BENCH_SIZES[size];
+        NodeGraph graph;
+        QVector<QPoint> scalarPositions;
+        qreal scalarRate = 0.0;
+
+        generateGraph(graph, count);
+
+        for (unsigned int set = 0; set < sizeof(FORCE_INSTRUCTION_SETS) / sizeof(FORCE_INSTRUCTION_SETS[0]); ++set) {
+            if (!ForceKernel::setInstructionSet(FORCE_INSTRUCTION_SETS[set]))
+                continue;
+
+            ForceShapePositionCalc calc;
+            calc.setGraph(&graph);
+            calc.setMaxIterations(FORCE_BENCH_ITERATIONS);
+            calc.setConvergenceThreshold(0.0);
+            calc.setThreadCount(1);
+
+            QElapsedTimer timer;
+            timer.start();
+            calc.calculate();
+
+            const qreal seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+            const qreal rate = count * FORCE_BENCH_ITERATIONS / seconds;
+
+            std::cout << "  " << count << " nodes, " << ForceKernel::instructionSet() << ": "
+                      << qRound64(rate) << " nodes/s per iteration";
+
+            // Every version adds the points up in the same order, see ForceKernel
+            QVector<QPoint> positions(count);
+
+            for (int row = 0; row < count; ++row)
+                positions[row] = graph.position(row);
+
+            if (scalarPositions.isEmpty()) {
+                scalarPositions = positions;
+                scalarRate = rate;
+            }
+            else {
+                std::cout << " (x" << QString::number(rate / scalarRate, 'f', 2).toStdString() << ")";
+
+                if (positions != scalarPositions) {
+                    std::cout << ", but not the same layout as the scalar version";
+                    ok = false;
+                }
+            }
+
+            std::cout << std::endl;
+        }
+    }
+
+    ForceKernel::setInstructionSet(selected);
+
+    return ok;
+}
+
+/*
+ *  Returns about [size] bytes of C++ like source: mostly indented code and comments, some
+ *  with '#' in them, and an #include line (some indented) every few lines
+ */
+QByteArray Benchmark::generateSource(int size)
+{
+    static const char* const LINES[] = {
+        "    for (int i = 0; i < count; ++i) {\n",
+        "        total += values[i] * weights[i];   // Sum up the weighted values\n",
+        "    }\n",
+        "\n",
+        "/*\n",
+        " *  Returns the '#' separated name of the item, e.g. \"a#b\"\n",
+        " */\n",
+        "QString Item::name() const { return _parent->name() + '#' + _name; }\n",
+        "    const QColor color(\"#ff8000\");\n",
+        "\tif (pos == end)\n",
+        "\t\treturn false;\n",
+        "        // Step # 2 of the walk, see above\n"
+    };
+    static const int LINE_COUNT = sizeof(LINES) / sizeof(LINES[0]);
+
+    quint32 state = 1;
+    QByteArray source;
+    source.reserve(size + 256);
+
+    for (int line = 0; source.size() < size; ++line) {
+        if (line % SCANNER_BENCH_LINES_PER_INCLUDE == 0) {
+            source += line % 3 == 0 ? "  " : "";
+            source += "#include \"dir/file" + QByteArray::number(nextRandom(state) % 1000) + ".h\"\n";
+        }
+        else if (line % SCANNER_BENCH_LINES_PER_INCLUDE == 1) {
+            source += "#define VALUE_" + QByteArray::number(line) + " 1\n";
+        }
+        else {
+            source += LINES[nextRandom(state) % LINE_COUNT];
+        }
+    }
+
+    return source;
+}
+
+/*
+ *  Fills the empty [graph] with [count] nodes connected like an include graph might be: each
+ *  node with one of the nodes before it, and a few more edges between nodes picked at random
+ */
+void Benchmark::generateGraph(NodeGraph& graph, int count)
+{
+    quint32 state = 1;
+
+    for (int i = 0; i < count; ++i)
+        graph.addNode(NameTable::intern(QString("bench/node%1.h").arg(i)));
+
+    for (int row = 1; row < count; ++row)
+        graph.setEdge(nextRandom(state) % row, row, 1);
+
+    for (int i = 0; i < count * FORCE_BENCH_EXTRA_EDGES; ++i) {
+        const int parentRow = nextRandom(state) % count;
+        const int childRow = nextRandom(state) % count;
+
+        if (parentRow != childRow)
+            graph.setEdge(parentRow, childRow, 1);
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * benchmark.h
+ *
+ * Benchmark times the inner loops that have versions for several instruction sets against
+ * each other on generated data, and prints the results, see 'visnode --bench'. Nothing is
+ * parsed or shown.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QByteArray>
+
+class NodeGraph;
+
+class Benchmark
+{
+public:
+    static int run();
+
+private:
+    Benchmark();
+
+    static bool benchDirectiveScanner();
+    static bool benchForceKernel();
+    static bool benchForceLayout();
+    static QByteArray generateSource(int size);
+    static void generateGraph(NodeGraph& graph, int count);
+};
+
+#endif // BENCHMARK_H
@@ -1,5 +1,5 @@
 #include "circleshapepositioncalc.h"
-#include "nodeitem.h"
+#include "nodegraph.h"
 #include <qmath.h>
 #include <QDebug>
 
@@ -10,10 +10,9 @@ static const int CIRCLE_SHAPE_INC_PER_ITEM = 20;
 /*
  *  Constructor
  */
-CircleShapePositionCalc::CircleShapePositionCalc(QList<NodeItem*>& nodelist)
-    : AbstractNodeItemPositionCalc(nodelist), knownNumNodes(0)
+CircleShapePositionCalc::CircleShapePositionCalc()
+    : knownNumNodes(0)
 {
-    _currentSize = calculateRelativeSize();
 }
 
 /*
@@ -22,10 +21,9 @@ CircleShapePositionCalc::CircleShapePositionCalc(QList<NodeItem*>& nodelist)
  *  At the current stage, it just positions them in a circle and spreads the nodes
  *  with many children in a roughly even manner.
  *
- *  Call this:
- *  1) In the beginning when all nodes have been added from parsing the file(s)
- *  2) If a new node is added to an already created model. (Editable model not implemented yet!)
- *     Also make sure to call moveTo([new position]) afterwards.
+ *  Call this in the beginning when all nodes have been added from parsing the file(s).
+ *  Nodes added or changed later are placed without calculating all positions again,
+ *  see placeNodes() and relaxNodes().
  */
 void CircleShapePositionCalc::calculate()
 {
@@ -34,12 +32,21 @@ void CircleShapePositionCalc::calculate()
 
 
 /*
- *  Comparator function for sorting of the node list
+ *  Comparator for sorting of the rows, on the child count of their nodes
  */
-bool nodeItemSortChildCount(const NodeItem* node1, const NodeItem* node2)
+class NodeSortChildCount
 {
-    return node1->childCount() > node2->childCount();
-}
+public:
+    NodeSortChildCount(const NodeGraph& graph) : _graph(graph) {}
+
+    bool operator()(int row1, int row2) const
+    {
+        return _graph.childCount(row1) > _graph.childCount(row2);
+    }
+
+private:
+    const NodeGraph& _graph;
+};
 
 /*
  *  Creates the node map by determining the positions of all the nodes, based on
@@ -50,35 +57,41 @@ void CircleShapePositionCalc::circleShape()
 {
     // If the number of nodes has changed since last time the size was calculated
     // As of 2013-05-17, this is not an issue, as the list's size is constant
-    if (knownNumNodes != _nodelist.size()) {
-        knownNumNodes = _nodelist.size();
+    if (knownNumNodes != _graph->nodeCount()) {
+        knownNumNodes = _graph->nodeCount();
         _currentSize = calculateRelativeSize();
     }
 
     int maxWidth = _currentSize.width();
 
-    qSort(_nodelist.begin(), _nodelist.end(), nodeItemSortChildCount);  // Sorts the nodes on childCount
+    // The rows in the order the nodes are placed in
+    QVector<int> rows(_graph->nodeCount());
+
+    for (int i = 0; i < rows.size(); ++i)
+        rows[i] = i;
+
+    qSort(rows.begin(), rows.end(), NodeSortChildCount(*_graph));      // Sorts the nodes on childCount
 
-    spreadNodelistOnChildCount();
+    spreadNodelistOnChildCount(rows);
 
     int radius = (static_cast<qreal>(maxWidth) / 2.0) * 0.9;    // Make the radius from the center less than half to
                                                                 // avoid that nodes are drawn partially outside the view.
 
-    qreal radiansBetweenNodes = (M_PI / 180.0) * (360.0 / _nodelist.size());
+    qreal radiansBetweenNodes = (M_PI / 180.0) * (360.0 / rows.size());
     int xpos, ypos;
 
     // Set the coords for all nodes, circle wise around (0,0)
     // Note that the positions will need to be translated later during painting
-    for (int i = 0; i < _nodelist.size(); ++i) {
+    for (int i = 0; i < rows.size(); ++i) {
         xpos = radius * qCos(radiansBetweenNodes * i);      // cos v = x / r <=> x = r * cos v
         ypos = radius * qSin(radiansBetweenNodes * i);      // sin v = y / r <=> y = r * sin v
-        _nodelist[i]->setPosition(QPoint(xpos, ypos));
+        _graph->setPosition(rows.at(i), QPoint(xpos, ypos));
     }
 }
 
 
 /*
- *  This function uses a simple spreading algorithm of the values in the nodelist.
+ *  This function uses a simple spreading algorithm of the values in [rows].
  *  The point is to even out the position of nodes with many children among the entire range of nodes,
  *  making the graphical representation easier to interpret.
  *  Unless the list is sorted before calling the function, the spread is rather useless.
@@ -90,13 +103,13 @@ void CircleShapePositionCalc::circleShape()
  *      Swap the current node with that on the position just determined
  *      Let the next current node be the one found one step backwards from the opposite one used above
  */
-void CircleShapePositionCalc::spreadNodelistOnChildCount()
+void CircleShapePositionCalc::spreadNodelistOnChildCount(QVector<int>& rows)
 {
     // Prepare the variables
     int swapIndexFirst = 1;                 // Note index start at 1, as we don't want to spread index 0 == the node with most children
     int swapIndexSecond;
-    int totalSwaps = _nodelist.size() / 3;  // Seems like a good number of swaps, at least for small number of nodes
-    qreal listSize = _nodelist.size();      // Store the size as a real number (avoid implicit integer assumptions/conversion)
+    int totalSwaps = rows.size() / 3;       // Seems like a good number of swaps, at least for small number of nodes
+    qreal listSize = rows.size();           // Store the size as a real number (avoid implicit integer assumptions/conversion)
 
     // Make the swaps and perform the next swap calculations
     for (int i = 0; i < totalSwaps; ++i) {
@@ -105,7 +118,7 @@ void CircleShapePositionCalc::spreadNodelistOnChildCount()
         if (swapIndexSecond <= -1)
             swapIndexSecond = listSize - 1;
 
-        swapNodes(_nodelist[swapIndexFirst], _nodelist[swapIndexSecond]);
+        swapNodes(rows[swapIndexFirst], rows[swapIndexSecond]);
         swapIndexFirst = swapIndexSecond - 1;                           // Move one step backwards, using the last second index as firs next time
 
         if (swapIndexFirst <= -1)
@@ -114,16 +127,16 @@ void CircleShapePositionCalc::spreadNodelistOnChildCount()
 }
 
 
-void CircleShapePositionCalc::swapNodes(NodeItem*& node1, NodeItem*& node2)
+void CircleShapePositionCalc::swapNodes(int& row1, int& row2)
 {
-    NodeItem* temp = node1;
-    node1 = node2;
-    node2 = temp;
+    int temp = row1;
+    row1 = row2;
+    row2 = temp;
 }
 
 QSize CircleShapePositionCalc::calculateRelativeSize() const
 {
-    int width = CIRCLE_SHAPE_MIN_SIZE + _nodelist.size() * CIRCLE_SHAPE_INC_PER_ITEM;
+    int width = CIRCLE_SHAPE_MIN_SIZE + _graph->nodeCount() * CIRCLE_SHAPE_INC_PER_ITEM;
     int height = width;                                                 // For now, use a square..
 
     QSize size(width + 40, height + 40);
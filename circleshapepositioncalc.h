@@ -12,14 +12,12 @@
 #define CIRCLESHAPEPOSITIONCALC_H
 
 #include "abstractnodeitempositioncalc.h"
-#include <QList>
-
-class NodeItem;
+#include <QVector>
 
 class CircleShapePositionCalc : public AbstractNodeItemPositionCalc
 {
 public:
-    CircleShapePositionCalc(QList<NodeItem *> &nodelist);
+    CircleShapePositionCalc();
 
     virtual void calculate();
 
@@ -29,8 +27,8 @@ private:
     void circleShape();
 
     QSize calculateRelativeSize() const;
-    void spreadNodelistOnChildCount();
-    void swapNodes(NodeItem*& node1, NodeItem*& node2);
+    void spreadNodelistOnChildCount(QVector<int>& rows);
+    void swapNodes(int& row1, int& row2);
 };
 
 #endif // CIRCLESHAPEPOSITIONCALC_H
@@ -0,0 +1,490 @@
+#include "compiledatabasereader.h"
+#include <cstring>              // memcmp(), strlen()
+
+
+/*
+ *  Returns true if the raw (undecoded) string [start, end) equals [literal]
+ */
+static inline bool rawEquals(const char* start, const char* end, const char* literal)
+{
+    size_t length = strlen(literal);
+    return static_cast<size_t>(end - start) == length && memcmp(start, literal, length) == 0;
+}
+
+
+/*
+ *  Returns the value of a hexadecimal digit, or -1 if it isn't one
+ */
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+/*
+ *  Constructor
+ */
+CompileDatabaseReader::CompileDatabaseReader()
+    : _mapped(0), _pos(0), _end(0), _state(Failed)
+{
+}
+
+
+/*
+ *  Destructor
+ */
+CompileDatabaseReader::~CompileDatabaseReader()
+{
+    if (_mapped != 0)
+        _file.unmap(_mapped);
+}
+
+
+/*
+ *  Opens the compilation database and prepares to read the first command.
+ *  Returns false if the file can't be read.
+ */
+bool CompileDatabaseReader::open(const QString& fileName)
+{
+    _file.setFileName(fileName);
+
+    if (!_file.open(QFile::ReadOnly))
+        return false;
+
+    qint64 size = _file.size();
+    _mapped = size > 0 ? _file.map(0, size) : 0;
+
+    // If the file can't be mapped (e.g. not a regular file), read it into memory instead
+    if (_mapped != 0) {
+        _pos = reinterpret_cast<const char*>(_mapped);
+        _end = _pos + size;
+    }
+    else {
+        _buffer = _file.readAll();
+        _pos = _buffer.constData();
+        _end = _pos + _buffer.size();
+    }
+
+    _state = BeforeArray;
+
+    return true;
+}
+
+
+/*
+ *  Reads the next command of the database into [command].
+ *  Returns false when there are no more commands, or if the JSON is malformed (see hasError()).
+ */
+bool CompileDatabaseReader::readNext(CompileCommand& command)
+{
+    if (_state == Done || _state == Failed)
+        return false;
+
+    skipWhitespace();
+
+    if (_state == BeforeArray) {
+        // The database is an array of command objects
+        if (!consume('['))
+            return fail();
+
+        _state = InArray;
+        skipWhitespace();
+    }
+    else if (!consume(',')) {
+        // No more commands if the array ends here
+        if (!consume(']'))
+            return fail();
+
+        _state = Done;
+        return false;
+    }
+
+    skipWhitespace();
+
+    if (consume(']')) {
+        _state = Done;
+        return false;
+    }
+
+    if (!readCommand(command))
+        return fail();
+
+    return true;
+}
+
+
+/*
+ *  Returns true if the database turned out to be malformed
+ */
+bool CompileDatabaseReader::hasError() const
+{
+    return _state == Failed;
+}
+
+
+/*
+ *  Reads a command object, e.g:
+ *      { "directory": "/build", "file": "../src/main.cpp", "command": "c++ -Iinclude -c ../src/main.cpp" }
+ *  If there's both an "arguments" array and a "command" string, the arguments are used.
+ */
+bool CompileDatabaseReader::readCommand(CompileCommand& command)
+{
+    QString commandLine;
+    bool hasArguments = false;
+
+    command = CompileCommand();
+
+    if (!consume('{'))
+        return false;
+
+    skipWhitespace();
+
+    if (!consume('}')) {
+        forever {
+            const char* keyStart;
+            const char* keyEnd;
+            bool escaped;
+
+            if (!scanString(keyStart, keyEnd, escaped))
+                return false;
+
+            skipWhitespace();
+
+            if (!consume(':'))
+                return false;
+
+            skipWhitespace();
+
+            bool ok;
+
+            if (rawEquals(keyStart, keyEnd, "directory")) {
+                ok = readString(command.directory);
+            }
+            else if (rawEquals(keyStart, keyEnd, "file")) {
+                ok = readString(command.file);
+            }
+            else if (rawEquals(keyStart, keyEnd, "command")) {
+                ok = readString(commandLine);
+            }
+            else if (rawEquals(keyStart, keyEnd, "arguments")) {
+                ok = readStringArray(command.arguments);
+                hasArguments = true;
+            }
+            else {
+                ok = skipValue();           // E.g. "output", not needed
+            }
+
+            if (!ok)
+                return false;
+
+            skipWhitespace();
+
+            if (consume('}'))
+                break;
+
+            if (!consume(','))
+                return false;
+
+            skipWhitespace();
+        }
+    }
+
+    if (!hasArguments)
+        command.arguments = splitCommandLine(commandLine);
+
+    return true;
+}
+
+
+/*
+ *  Reads and decodes a string value
+ */
+bool CompileDatabaseReader::readString(QString& value)
+{
+    const char* start;
+    const char* end;
+    bool escaped;
+
+    if (!scanString(start, end, escaped))
+        return false;
+
+    value = decodeString(start, end, escaped);
+
+    return true;
+}
+
+
+/*
+ *  Reads an array of string values
+ */
+bool CompileDatabaseReader::readStringArray(QStringList& values)
+{
+    values.clear();
+
+    if (!consume('['))
+        return false;
+
+    skipWhitespace();
+
+    if (consume(']'))
+        return true;
+
+    forever {
+        QString value;
+
+        if (!readString(value))
+            return false;
+
+        values.append(value);
+        skipWhitespace();
+
+        if (consume(']'))
+            return true;
+
+        if (!consume(','))
+            return false;
+
+        skipWhitespace();
+    }
+}
+
+
+/*
+ *  Moves past a string at the current position, without decoding it.
+ *  [start, end) is set to the raw contents between the quotes, and [escaped] tells if
+ *  it contains any escape sequences that need decoding.
+ */
+bool CompileDatabaseReader::scanString(const char*& start, const char*& end, bool& escaped)
+{
+    if (!consume('"'))
+        return false;
+
+    start = _pos;
+    escaped = false;
+
+    while (_pos < _end && *_pos != '"') {
+        if (*_pos == '\\') {
+            escaped = true;
+            ++_pos;                 // Skip the escaped character, it may be a '"'
+        }
+        ++_pos;
+    }
+
+    if (_pos >= _end)
+        return false;
+
+    end = _pos;
+    ++_pos;                         // Skip the closing '"'
+
+    return true;
+}
+
+
+/*
+ *  Moves past a value of any kind (string, number, literal, object or array) without decoding it.
+ *  Nested values are handled using a depth counter instead of recursion.
+ */
+bool CompileDatabaseReader::skipValue()
+{
+    int depth = 0;
+
+    do {
+        skipWhitespace();
+
+        if (_pos >= _end)
+            return false;
+
+        const char c = *_pos;
+
+        if (c == '"') {
+            const char* start;
+            const char* end;
+            bool escaped;
+
+            if (!scanString(start, end, escaped))
+                return false;
+        }
+        else if (c == '{' || c == '[') {
+            ++depth;
+            ++_pos;
+        }
+        else if (c == '}' || c == ']' || c == ',' || c == ':') {
+            // Only valid inside an object or array
+            if (depth == 0)
+                return false;
+
+            if (c == '}' || c == ']')
+                --depth;
+
+            ++_pos;
+        }
+        else {
+            // A number or a literal (true, false, null)
+            const char* start = _pos;
+
+            while (_pos < _end && ((*_pos >= '0' && *_pos <= '9') || (*_pos >= 'a' && *_pos <= 'z') ||
+                                   (*_pos >= 'A' && *_pos <= 'Z') || *_pos == '-' || *_pos == '+' || *_pos == '.'))
+                ++_pos;
+
+            if (_pos == start)
+                return false;
+        }
+    } while (depth > 0);
+
+    return true;
+}
+
+
+/*
+ *  Skips JSON whitespace
+ */
+void CompileDatabaseReader::skipWhitespace()
+{
+    while (_pos < _end && (*_pos == ' ' || *_pos == '\t' || *_pos == '\n' || *_pos == '\r'))
+        ++_pos;
+}
+
+
+/*
+ *  Moves past the character [c] if it's at the current position, and returns true.
+ *  Otherwise false is returned.
+ */
+bool CompileDatabaseReader::consume(char c)
+{
+    if (_pos < _end && *_pos == c) {
+        ++_pos;
+        return true;
+    }
+    return false;
+}
+
+
+/*
+ *  Marks the reader as failed, the rest of the database is ignored. Always returns false.
+ */
+bool CompileDatabaseReader::fail()
+{
+    _state = Failed;
+    return false;
+}
+
+
+/*
+ *  Decodes the raw contents of a JSON string (UTF-8, with escape sequences) to a QString
+ */
+QString CompileDatabaseReader::decodeString(const char* start, const char* end, bool escaped)
+{
+    if (!escaped)
+        return QString::fromUtf8(start, static_cast<int>(end - start));
+
+    QString value;
+    const char* chunk = start;          // Start of the bytes without escape sequences
+
+    value.reserve(static_cast<int>(end - start));
+
+    for (const char* pos = start; pos < end; ++pos) {
+        if (*pos != '\\')
+            continue;
+
+        value += QString::fromUtf8(chunk, static_cast<int>(pos - chunk));
+        ++pos;
+
+        switch (*pos) {
+            case 'b':   value += QChar('\b');   break;
+            case 'f':   value += QChar('\f');   break;
+            case 'n':   value += QChar('\n');   break;
+            case 'r':   value += QChar('\r');   break;
+            case 't':   value += QChar('\t');   break;
+            case 'u': {
+                // Four hex digits giving a UTF-16 code unit (surrogate pairs come as two escapes)
+                ushort unit = 0;
+                int i = 0;
+
+                for (; i < 4 && pos + 1 < end; ++i) {
+                    int digit = hexValue(pos[1]);
+
+                    if (digit < 0)
+                        break;
+
+                    unit = static_cast<ushort>(unit * 16 + digit);
+                    ++pos;
+                }
+
+                value += QChar(unit);
+                break;
+            }
+            default:    value += QChar::fromLatin1(*pos);   break;      // '"', '\\' and '/'
+        }
+
+        chunk = pos + 1;
+    }
+
+    value += QString::fromUtf8(chunk, static_cast<int>(end - chunk));
+
+    return value;
+}
+
+
+/*
+ *  Splits a command line into arguments the way a POSIX shell does: arguments are separated
+ *  by whitespace, single quotes keep everything literally, and backslashes escape the next
+ *  character (in double quotes only '"', '\\', '$' and '`').
+ */
+QStringList CompileDatabaseReader::splitCommandLine(const QString& commandLine)
+{
+    QStringList arguments;
+    QString current;
+    bool inArgument = false;
+    QChar quote;                        // The quote character of the quoted part we're in, if any
+    const int length = commandLine.length();
+
+    for (int i = 0; i < length; ++i) {
+        const QChar c = commandLine.at(i);
+
+        if (quote == QChar('\'')) {
+            if (c == quote)
+                quote = QChar();
+            else
+                current += c;
+        }
+        else if (quote == QChar('"')) {
+            if (c == quote) {
+                quote = QChar();
+            }
+            else if (c == QChar('\\') && i + 1 < length && QString("\"\\$`").contains(commandLine.at(i + 1))) {
+                current += commandLine.at(++i);
+            }
+            else {
+                current += c;
+            }
+        }
+        else if (c.isSpace()) {
+            if (inArgument) {
+                arguments.append(current);
+                current.clear();
+                inArgument = false;
+            }
+        }
+        else {
+            inArgument = true;
+
+            if (c == QChar('\'') || c == QChar('"'))
+                quote = c;
+            else if (c == QChar('\\') && i + 1 < length)
+                current += commandLine.at(++i);
+            else
+                current += c;
+        }
+    }
+
+    if (inArgument)
+        arguments.append(current);
+
+    return arguments;
+}
@@ -0,0 +1,65 @@
+/*
+ * compiledatabasereader.h
+ *
+ * CompileDatabaseReader reads a compilation database (compile_commands.json), as produced by
+ * e.g. CMake, one command at a time. The file is memory mapped and read as a stream of JSON
+ * tokens, without building a document of it, so even very large databases are read with
+ * little memory. Only the "directory", "file", "command" and "arguments" values are decoded.
+ */
+
+#ifndef COMPILEDATABASEREADER_H
+#define COMPILEDATABASEREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+// A single entry in the compilation database
+struct CompileCommand
+{
+    QString directory;          // The working directory of the compilation
+    QString file;               // The translation unit's file, relative to directory or absolute
+    QStringList arguments;      // The compiler's arguments, including the compiler itself
+};
+
+class CompileDatabaseReader
+{
+public:
+    CompileDatabaseReader();
+    ~CompileDatabaseReader();
+
+    bool open(const QString& fileName);
+    bool readNext(CompileCommand& command);
+    bool hasError() const;
+
+    static QStringList splitCommandLine(const QString& commandLine);
+
+private:
+    enum State {
+        BeforeArray,
+        InArray,
+        Done,
+        Failed
+    };
+
+    bool readCommand(CompileCommand& command);
+    bool readString(QString& value);
+    bool readStringArray(QStringList& values);
+    bool scanString(const char*& start, const char*& end, bool& escaped);
+    bool skipValue();
+    void skipWhitespace();
+    bool consume(char c);
+    bool fail();
+
+    static QString decodeString(const char* start, const char* end, bool escaped);
+
+    QFile _file;
+    QByteArray _buffer;
+    uchar* _mapped;
+    const char* _pos;
+    const char* _end;
+    State _state;
+};
+
+#endif // COMPILEDATABASEREADER_H
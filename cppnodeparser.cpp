@@ -1,9 +1,15 @@
 #include "cppnodeparser.h"
-#include <QRegularExpression>
+#include "directivescanner.h"
+#include "includeresolver.h"
+#include "compiledatabasereader.h"
+#include "filenamequeue.h"
 #include <QFile>
-#include <QStringRef>
+#include <QFileInfo>
 #include <QDir>
+#include <QByteArray>
 #include <QColor>
+#include <cstring>              // memchr(), memcmp()
+#include <iostream>
 
 static const QColor STANDARD_COLOR(140,200,240);    // A light blue color
 static const QColor CUSTOM_COLOR(180,255,150);      // A light green color
@@ -11,8 +17,19 @@ static const QColor CUSTOM_COLOR(180,255,150);      // A light green color
 /*
  *  Constructor
  */
-CPPNodeParser::CPPNodeParser(QList<NodeItem*>& nodeList)
-    : AbstractNodeParser(nodeList)
+CPPNodeParser::CPPNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena)
+    : AbstractNodeParser(nodeList, nodeIndex, nodeArena)
+{
+    CompileContext defaultContext;
+    defaultContext.resolver = QSharedPointer<IncludeResolver>(new IncludeResolver);
+    _contexts.append(defaultContext);
+}
+
+/*
+ *  Constructor for worker parsers, sharing the search paths and the caches of resolved includes
+ */
+CPPNodeParser::CPPNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena, const QList<CompileContext>& contexts)
+    : AbstractNodeParser(nodeList, nodeIndex, nodeArena), _contexts(contexts)
 {
 }
 
@@ -23,71 +40,345 @@ CPPNodeParser::~CPPNodeParser()
 {
 }
 
+/*
+ *  Creates a parser of the same kind, used to parse files on worker threads
+ */
+AbstractNodeParser* CPPNodeParser::createWorkerParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena) const
+{
+    return new CPPNodeParser(nodeList, nodeIndex, nodeArena, _contexts);
+}
+
+/*
+ *  Adds a directory to search for included files in, like the compiler's -I option.
+ *  Applies to the files given on the command line, not to those from compilation databases.
+ */
+void CPPNodeParser::addIncludePath(const QString& path)
+{
+    _contexts.first().resolver->addIncludePath(path);
+    _contexts.first().flags += "-I" + QDir(path).absolutePath() + '\n';
+}
+
+/*
+ *  Adds a system directory to search for included files in, like the compiler's -isystem option.
+ *  Applies to the files given on the command line, not to those from compilation databases.
+ */
+void CPPNodeParser::addSystemIncludePath(const QString& path)
+{
+    _contexts.first().resolver->addSystemIncludePath(path);
+    _contexts.first().flags += "-isystem" + QDir(path).absolutePath() + '\n';
+}
+
+/*
+ *  Returns the include paths and defines of the [context], as the files' results depend on them
+ */
+QString CPPNodeParser::contextFlags(int context) const
+{
+    return _contexts.at(context).flags;
+}
+
+/*
+ *  Takes the value of the compiler option [option] at arguments[index], either attached
+ *  (e.g. "-Iinclude") or as the next argument (e.g. "-I include"), in which case [index] is
+ *  moved past it. Returns false if the argument isn't the option.
+ */
+static bool takeOptionValue(const QStringList& arguments, int& index, const QString& option, QString& value)
+{
+    const QString& argument = arguments.at(index);
+
+    if (!argument.startsWith(option))
+        return false;
+
+    if (argument.length() > option.length()) {
+        value = argument.mid(option.length());
+        return true;
+    }
+
+    if (index + 1 >= arguments.size())
+        return false;
+
+    value = arguments.at(++index);
+    return true;
+}
+
+/*
+ *  Sets up the context for a translation unit compiled with [arguments] in [directory], taking
+ *  its -iquote, -I and -isystem paths (relative ones are relative to [directory]) and its -D and -U
+ *  options. Translation units compiled with the same flags share a context.
+ *  Returns the context's id, to be queued with the unit's file (see FileNameQueue).
+ */
+int CPPNodeParser::addCompileContext(const QStringList& arguments, const QString& directory)
+{
+    const QDir dir(directory);
+    QStringList quotePaths, includePaths, systemPaths;
+    QHash<QByteArray, QByteArray> defines;
+
+    for (int i = 0; i < arguments.size(); ++i) {
+        QString value;
+
+        if (takeOptionValue(arguments, i, "-iquote", value)) {
+            quotePaths.append(QDir::cleanPath(dir.absoluteFilePath(value)));
+        }
+        else if (takeOptionValue(arguments, i, "-isystem", value)) {
+            systemPaths.append(QDir::cleanPath(dir.absoluteFilePath(value)));
+        }
+        else if (takeOptionValue(arguments, i, "-I", value)) {
+            includePaths.append(QDir::cleanPath(dir.absoluteFilePath(value)));
+        }
+        else if (takeOptionValue(arguments, i, "-D", value)) {
+            // -DNAME defines NAME as 1, like the compiler does
+            const int equals = value.indexOf('=');
+
+            if (equals < 0)
+                defines.insert(value.toUtf8(), "1");
+            else
+                defines.insert(value.left(equals).toUtf8(), value.mid(equals + 1).toUtf8());
+        }
+        else if (takeOptionValue(arguments, i, "-U", value)) {
+            defines.remove(value.toUtf8());
+        }
+    }
+
+    // The flags that matter to the parsing identify the context, the rest (e.g. -O2) are ignored
+    QList<QByteArray> names = defines.keys();
+    qSort(names);
+
+    QStringList flags;
+    flags << quotePaths.join("\n") << includePaths.join("\n") << systemPaths.join("\n");
+
+    foreach (const QByteArray& name, names)
+        flags << QString::fromUtf8(name + '=' + defines.value(name));
+
+    const QString key = flags.join("\n\n");
+    QHash<QString, int>::const_iterator found = _contextIds.constFind(key);
+
+    if (found != _contextIds.constEnd())
+        return found.value();
+
+    CompileContext context;
+    context.resolver = QSharedPointer<IncludeResolver>(new IncludeResolver);
+    context.defines = defines;
+    context.flags = key;
+
+    foreach (const QString& path, quotePaths)
+        context.resolver->addQuoteIncludePath(path);
+    foreach (const QString& path, includePaths)
+        context.resolver->addIncludePath(path);
+    foreach (const QString& path, systemPaths)
+        context.resolver->addSystemIncludePath(path);
+
+    _contexts.append(context);
+    _contextIds.insert(key, _contexts.size() - 1);
+
+    return _contexts.size() - 1;
+}
+
+/*
+ *  Reads a compilation database (compile_commands.json) and queues the file of each command,
+ *  in the context of the command's flags. The database is read one command at a time.
+ *  Returns false if the database can't be read or is malformed.
+ */
+bool CPPNodeParser::queueCompileDatabase(const QString& fileName, FileNameQueue& queue)
+{
+    CompileDatabaseReader reader;
+
+    if (!reader.open(fileName)) {
+        std::cerr << "Couldn't open the compilation database " << fileName.toStdString() << std::endl;
+        return false;
+    }
+
+    CompileCommand command;
+
+    while (reader.readNext(command)) {
+        const QString file = QDir(command.directory).absoluteFilePath(command.file);
+        queue.enqueue(QDir::cleanPath(file), addCompileContext(command.arguments, command.directory));
+    }
+
+    if (reader.hasError()) {
+        std::cerr << "The compilation database " << fileName.toStdString() << " is malformed" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 /*
  *  Processes the file, looking at lines starting with #include,
  *  creating nodes from the those classes when such lines are found.
- *  Currently just returns true...
+ *
+ *  The file is memory mapped and scanned as raw bytes. The DirectiveScanner finds
+ *  the directive lines, and strings are only created for the names of the included files.
+ *  Returns false if the file couldn't be read.
  */
 bool CPPNodeParser::processFile(QFile& file)
 {
-    // The path separator character, translated to native symbol, excludes comments
-    QRegularExpression rxNativeSlash(QString("[^/]") + QDir::toNativeSeparators("/") + QString("{1}[^/\\*\\s]"));
+    const CompileContext& context = _contexts.at(currentContext());
 
-    QRegularExpression rxInclude("^#include");          // The word 'include' is at the beginning of the line
-    QRegularExpression rxStartName("[<\"]");            // The characters '<' or '"' ("path container" start)
-    QRegularExpression rxEndName("[>\"]");              // The characters '>' or '"' ("path container" end)
+    // Use the canonical path as the file's identity, the same path its includers will resolve to
+    QString fileName = context.resolver->canonicalPath(file.fileName());
 
-    // Setup the file to stream from
-    stream.setDevice(&file);
+    if (fileName.isEmpty())
+        fileName = QFileInfo(file.fileName()).absoluteFilePath();
 
-    QString fileName = file.fileName();
+    const QString directory = QFileInfo(fileName).path();
+    const quint32 fileId = NameTable::intern(fileName);
 
-    // Look for the folder separator symbol in the filename (path)
-    int fileSlashIndex = fileName.lastIndexOf(rxNativeSlash);
+    // Create a node of the current file, even if it doesn't include anything
+    nodeCreator()->createStandAloneNode(fileId, CUSTOM_COLOR);
 
-    // If the fileName (incl. path) contains a folder separator symbol, create a substring with just the filename and extension
-    if (fileSlashIndex != -1)
-        fileName = QStringRef(&fileName, fileSlashIndex+2, fileName.length()-fileSlashIndex-2).toString();
+    qint64 size = file.size();
 
-    // Looks like it isn't needed anymore, but I'll keep these lines until later...
-    // Create a node of the current file
-    if (nodeCreator()->getNode(fileName) == NULL)
-        nodeCreator()->createStandAloneNode(fileName, CUSTOM_COLOR);
+    if (size == 0)
+        return true;
 
-    QString line;
-    QStringRef foundName;
-    QColor nodeColor;
+    QByteArray buffer;
+    uchar* mapped = file.map(0, size);
+    const char* data = reinterpret_cast<const char*>(mapped);
 
-    // Read all lines in the stream
-    while (!stream.atEnd()) {
-        line = stream.readLine();
-        line = line.trimmed();                          // Remove all spaces at the beginning and the end of the line
+    // If the file can't be mapped (e.g. not a regular file), read it into memory instead
+    if (mapped == NULL) {
+        buffer = file.readAll();
 
-        // If the line starts with 'include'
-        if (rxInclude.match(line).hasMatch()) {
-            // If it's a non-standard class (ought to be if it's path is set with ""), give it a custom color
-            if (line.contains('"'))
-                nodeColor = CUSTOM_COLOR;
-            else
-                nodeColor = STANDARD_COLOR;
+        if (file.error() != QFile::NoError)
+            return false;
 
-            int startIndex = line.indexOf(rxStartName);         // Get index of the "path container's" start character
-            int endIndex = line.lastIndexOf(rxEndName);         // Get index of the "path container's" end character
-            int slashIndex = line.lastIndexOf(rxNativeSlash);   // Get index of any '/' character (e.g. <sys/time.h>)
+        data = buffer.constData();
+        size = buffer.size();
+    }
 
-            // If a slash character was found, replace startIndex
-            if (slashIndex != -1)
-                startIndex = slashIndex + 1;
+    const char* end = data + size;
+    DirectiveScanner scanner(data, end);
 
-            startIndex += 1;                            // We want to start at the character just after startIndex
+    // Go through the directive lines of the file only, the scanner skips all other lines
+    const char* lineStart = scanner.findNext(data);
 
-            foundName = QStringRef(&line, startIndex, endIndex-startIndex);     // Get the substring with the name of the file/unit
+    while (lineStart != NULL) {
+        const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', end - lineStart));
 
-            _nodeCreator->createNode(foundName.toString(), fileName, nodeColor, CUSTOM_COLOR); // Create the node!
-        }
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        processLine(lineStart, lineEnd, fileId, directory, context);
+
+        lineStart = scanner.findNext(lineEnd);
     }
 
-    stream.resetStatus();
+    if (mapped != NULL)
+        file.unmap(mapped);
 
     return true;
 }
+
+
+/*
+ *  Returns true for the whitespace characters QString::trimmed() would remove on a line
+ */
+static inline bool isLineSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+
+/*
+ *  Returns true for the characters of a macro name
+ */
+static inline bool isIdentifierChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+
+/*
+ *  Finds the "path container" of an include, <path> or "path", in [pos, end).
+ *  [nameStart, nameEnd) is set to the path and [quoted] tells if it's in quotes.
+ *  Returns false if there's no (non-empty) path.
+ */
+static bool findIncludePath(const char* pos, const char* end, const char*& nameStart, const char*& nameEnd, bool& quoted)
+{
+    // Find the start character of the "path container", '<' or '"'
+    while (pos < end && *pos != '<' && *pos != '"')
+        ++pos;
+
+    if (pos == end)
+        return false;
+
+    quoted = (*pos == '"');
+    nameStart = ++pos;
+
+    // Find the matching end character of the "path container", '>' or '"'
+    while (pos < end && *pos != (quoted ? '"' : '>'))
+        ++pos;
+
+    if (pos == end || pos == nameStart)
+        return false;
+
+    nameEnd = pos;
+    return true;
+}
+
+
+/*
+ *  Looks at a single line [lineStart, lineEnd) and creates a node (and edge from the file, [fileId])
+ *  if it's an #include line. E.g. both '#include "dir/file.h"' and '  #include <sys/time.h>'
+ *  are accepted, as is '#include CONFIG_H' if CONFIG_H is defined in the [context].
+ *  The node is named by the included file's canonical path if it's found
+ *  (see IncludeResolver), otherwise by the path as written, e.g. "sys/time.h".
+ *  [directory] is the directory of the file being processed.
+ */
+void CPPNodeParser::processLine(const char* lineStart, const char* lineEnd, quint32 fileId,
+                                const QString& directory, const CompileContext& context)
+{
+    static const char INCLUDE[] = "#include";
+    static const int INCLUDE_LENGTH = sizeof(INCLUDE) - 1;
+
+    const char* pos = lineStart;
+
+    // Skip the whitespace at the beginning of the line
+    while (pos < lineEnd && isLineSpace(*pos))
+        ++pos;
+
+    // If the line doesn't start with '#include', there's nothing to find here
+    if (lineEnd - pos < INCLUDE_LENGTH || memcmp(pos, INCLUDE, INCLUDE_LENGTH) != 0)
+        return;
+
+    pos += INCLUDE_LENGTH;
+
+    const char* nameStart;
+    const char* nameEnd;
+    bool custom;
+    QByteArray expansion;
+
+    if (!findIncludePath(pos, lineEnd, nameStart, nameEnd, custom)) {
+        // The path may be given by a macro instead, which is looked up in the -D defines
+        while (pos < lineEnd && isLineSpace(*pos))
+            ++pos;
+
+        const char* macroStart = pos;
+
+        while (pos < lineEnd && isIdentifierChar(*pos))
+            ++pos;
+
+        if (pos == macroStart || context.defines.isEmpty())
+            return;
+
+        expansion = context.defines.value(QByteArray(macroStart, static_cast<int>(pos - macroStart)));
+
+        if (!findIncludePath(expansion.constData(), expansion.constData() + expansion.size(), nameStart, nameEnd, custom))
+            return;
+    }
+
+    // If it's a non-standard class (ought to be if it's path is set with ""), give it a custom color
+    const QColor& nodeColor = custom ? CUSTOM_COLOR : STANDARD_COLOR;
+
+    // Get the path of the file/unit as written, the only string made for the line
+    QString spelling = QString::fromUtf8(nameStart, static_cast<int>(nameEnd - nameStart));
+
+    QString foundName = context.resolver->resolve(spelling, custom, directory);
+
+    // If the included file was found on disk, it may be parsed as well (see setFollowFoundFiles())
+    if (foundName.isEmpty())
+        foundName = spelling;
+    else
+        addFoundFile(foundName);
+
+    _nodeCreator->createNode(NameTable::intern(foundName), fileId, nodeColor, CUSTOM_COLOR); // Create the node!
+}
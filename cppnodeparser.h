@@ -11,23 +11,51 @@
 #define CPPNODEPARSER_H
 
 #include "abstractnodeparser.h"
-#include <QTextStream>
+#include <QByteArray>
+#include <QHash>
 #include <QList>
+#include <QSharedPointer>
+#include <QStringList>
 
 class QFile;
+class QString;
 class NodeItem;
+class IncludeResolver;
+class FileNameQueue;
 
 class CPPNodeParser : public AbstractNodeParser
 {
 public:
-    CPPNodeParser(QList<NodeItem*>& nodeList);
+    CPPNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena);
     virtual ~CPPNodeParser();
 
+    void addIncludePath(const QString& path);
+    void addSystemIncludePath(const QString& path);
+
+    int addCompileContext(const QStringList& arguments, const QString& directory);
+    bool queueCompileDatabase(const QString& fileName, FileNameQueue& queue);
+
 protected:
     bool processFile(QFile& file);
+    AbstractNodeParser* createWorkerParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena) const;
+    QString contextFlags(int context) const;
 
 private:
-    QTextStream stream;
+    // How the files of a translation unit are compiled: where includes are found and the -D defines
+    struct CompileContext
+    {
+        QSharedPointer<IncludeResolver> resolver;
+        QHash<QByteArray, QByteArray> defines;
+        QString flags;              // The paths and defines, one per line, identifying the context
+    };
+
+    CPPNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena, const QList<CompileContext>& contexts);
+
+    void processLine(const char* lineStart, const char* lineEnd, quint32 fileId,
+                     const QString& directory, const CompileContext& context);
+
+    QList<CompileContext> _contexts;        // Context 0 is the default one, set up by the command line
+    QHash<QString, int> _contextIds;        // The flags of the contexts from compilation databases
 };
 
 #endif // CPPNODEPARSER_H
@@ -0,0 +1,259 @@
+#include "directivescanner.h"
+#include <cstring>              // strcmp()
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define DIRECTIVESCANNER_X86_GNUC
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#  define DIRECTIVESCANNER_X86_MSVC
+#  include <emmintrin.h>
+#  include <intrin.h>
+#endif
+
+// The kernels return the first '#' in [pos, end) that is preceded by a newline or blank character,
+// i.e. a candidate for being the start of a directive. Note that pos[-1] must be readable.
+typedef const char* (*FindCandidateFunc)(const char* pos, const char* end);
+
+
+/*
+ *  Returns true if the character may be before a '#' starting a directive.
+ *  Control characters are accepted too, they are filtered out by isAtLineStart() later.
+ */
+static inline bool isCandidatePrefix(char c)
+{
+    return static_cast<unsigned char>(c) <= ' ';
+}
+
+
+/*
+ *  Plain byte by byte kernel, used when no SIMD support is available and for the tail of the data
+ */
+static const char* findCandidateScalar(const char* pos, const char* end)
+{
+    for (; pos < end; ++pos) {
+        if (*pos == '#' && isCandidatePrefix(pos[-1]))
+            return pos;
+    }
+    return end;
+}
+
+
+#if defined(DIRECTIVESCANNER_X86_GNUC) || defined(DIRECTIVESCANNER_X86_MSVC)
+
+/*
+ *  Returns the index of the lowest set bit in a non-zero mask
+ */
+static inline int lowestBit(unsigned int mask)
+{
+#if defined(DIRECTIVESCANNER_X86_MSVC)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+
+/*
+ *  SSE2 kernel, 16 bytes per step.
+ *  A byte is a candidate if it's '#' and the byte before it is <= ' ' (compared unsigned, using min).
+ */
+#if defined(DIRECTIVESCANNER_X86_GNUC)
+__attribute__((target("sse2")))
+#endif
+static const char* findCandidateSse2(const char* pos, const char* end)
+{
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i space = _mm_set1_epi8(' ');
+
+    while (end - pos >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos - 1));
+
+        __m128i isHash = _mm_cmpeq_epi8(chunk, hash);
+        __m128i prevIsBlank = _mm_cmpeq_epi8(_mm_min_epu8(prev, space), prev);
+
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(isHash, prevIsBlank));
+
+        if (mask != 0)
+            return pos + lowestBit(mask);
+
+        pos += 16;
+    }
+
+    return findCandidateScalar(pos, end);
+}
+
+
+#if defined(DIRECTIVESCANNER_X86_GNUC)
+/*
+ *  AVX2 kernel, the same as the SSE2 one but 32 bytes per step
+ */
+__attribute__((target("avx2")))
+static const char* findCandidateAvx2(const char* pos, const char* end)
+{
+    const __m256i hash = _mm256_set1_epi8('#');
+    const __m256i space = _mm256_set1_epi8(' ');
+
+    while (end - pos >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos - 1));
+
+        __m256i isHash = _mm256_cmpeq_epi8(chunk, hash);
+        __m256i prevIsBlank = _mm256_cmpeq_epi8(_mm256_min_epu8(prev, space), prev);
+
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(isHash, prevIsBlank)));
+
+        if (mask != 0)
+            return pos + lowestBit(mask);
+
+        pos += 32;
+    }
+
+    return findCandidateSse2(pos, end);
+}
+#endif
+
+#endif // x86
+
+
+/*
+ *  Picks the fastest kernel the CPU supports. Only done once.
+ */
+static FindCandidateFunc selectKernel(const char** name)
+{
+#if defined(DIRECTIVESCANNER_X86_GNUC)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return findCandidateAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return findCandidateSse2;
+    }
+#elif defined(DIRECTIVESCANNER_X86_MSVC)
+    *name = "sse2";                         // Always available on x64
+    return findCandidateSse2;
+#endif
+
+    *name = "scalar";
+    return findCandidateScalar;
+}
+
+static const char* kernelNameSelected = 0;
+static FindCandidateFunc findCandidate = selectKernel(&kernelNameSelected);
+
+
+/*
+ *  Constructor, [begin, end) is the contents of the file
+ */
+DirectiveScanner::DirectiveScanner(const char* begin, const char* end)
+    : _begin(begin), _end(end)
+{
+}
+
+
+/*
+ *  Returns a pointer to the next directive's '#' at or after [pos], or NULL if there are no more.
+ *  Only '#' characters that are the first non-blank character on their line are returned,
+ *  so the caller only needs to look at the actual directive lines.
+ */
+const char* DirectiveScanner::findNext(const char* pos) const
+{
+    if (pos >= _end)
+        return 0;
+
+    // The kernels look at the byte before each position, so handle the very first byte here
+    if (pos == _begin) {
+        if (*pos == '#')
+            return pos;
+        ++pos;
+    }
+
+    while (pos < _end) {
+        const char* candidate = findCandidate(pos, _end);
+
+        if (candidate == _end)
+            return 0;
+
+        if (isAtLineStart(candidate))
+            return candidate;
+
+        pos = candidate + 1;
+    }
+
+    return 0;
+}
+
+
+/*
+ *  Returns the name of the kernel used ("avx2", "sse2" or "scalar"), the fastest on this CPU
+ *  unless another one is set with setKernel()
+ */
+const char* DirectiveScanner::kernelName()
+{
+    return kernelNameSelected;
+}
+
+
+/*
+ *  Makes the scanners use the kernel [name], "avx2", "sse2" or "scalar".
+ *  Returns false, leaving it as it is, if the CPU (or the build) doesn't have it.
+ *  Mustn't be called while files are parsed.
+ */
+bool DirectiveScanner::setKernel(const char* name)
+{
+    if (strcmp(name, "scalar") == 0) {
+        findCandidate = findCandidateScalar;
+        kernelNameSelected = "scalar";
+        return true;
+    }
+
+#if defined(DIRECTIVESCANNER_X86_GNUC)
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        findCandidate = findCandidateAvx2;
+        kernelNameSelected = "avx2";
+        return true;
+    }
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        findCandidate = findCandidateSse2;
+        kernelNameSelected = "sse2";
+        return true;
+    }
+#elif defined(DIRECTIVESCANNER_X86_MSVC)
+    if (strcmp(name, "sse2") == 0) {
+        findCandidate = findCandidateSse2;
+        kernelNameSelected = "sse2";
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+
+/*
+ *  Verifies that there are only blanks between the start of the line and the '#' at [hash]
+ */
+bool DirectiveScanner::isAtLineStart(const char* hash) const
+{
+    for (const char* pos = hash - 1; pos >= _begin; --pos) {
+        switch (*pos) {
+            case '\n':
+                return true;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\v':
+            case '\f':
+                continue;
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
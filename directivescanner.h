@@ -0,0 +1,31 @@
+/*
+ * directivescanner.h
+ *
+ * DirectiveScanner finds the preprocessor directives in a C/C++ source file held in memory,
+ * i.e. the '#' characters that are the first non-blank character on their line.
+ * The candidates are searched 16 or 32 bytes at a time using SSE2 or AVX2, picked at runtime
+ * depending on the CPU, with a plain scalar loop as fallback. Another kernel the CPU runs can
+ * be picked with setKernel(), e.g. to compare them (see Benchmark).
+ */
+
+#ifndef DIRECTIVESCANNER_H
+#define DIRECTIVESCANNER_H
+
+class DirectiveScanner
+{
+public:
+    DirectiveScanner(const char* begin, const char* end);
+
+    const char* findNext(const char* pos) const;
+
+    static const char* kernelName();
+    static bool setKernel(const char* name);
+
+private:
+    bool isAtLineStart(const char* hash) const;
+
+    const char* _begin;
+    const char* _end;
+};
+
+#endif // DIRECTIVESCANNER_H
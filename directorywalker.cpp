@@ -0,0 +1,119 @@
+#include "directorywalker.h"
+#include "filenamequeue.h"
+#include <QDir>
+#include <QFileInfo>
+
+
+/*
+ *  Converts glob patterns (e.g. "*.h" or "build/*") to wildcard regular expressions
+ */
+static QList<QRegExp> toWildcards(const QStringList& patterns)
+{
+    QList<QRegExp> wildcards;
+
+    foreach (const QString& pattern, patterns) {
+        wildcards.append(QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard));
+    }
+
+    return wildcards;
+}
+
+
+/*
+ *  Constructor
+ *  Only files with one of the [extensions] (case insensitive) are added to the [queue].
+ */
+DirectoryWalker::DirectoryWalker(const QStringList& directories, const QStringList& extensions,
+                                 FileNameQueue& queue, QObject* parent)
+    : QThread(parent), _directories(directories), _extensions(extensions), _queue(queue)
+{
+}
+
+
+/*
+ *  Sets the glob patterns of the files to add. If no patterns are set, all files are added.
+ *  Patterns with a '/' are matched against the path relative to the walked directory,
+ *  other patterns against the file name only.
+ */
+void DirectoryWalker::setIncludePatterns(const QStringList& patterns)
+{
+    _includePatterns = toWildcards(patterns);
+}
+
+
+/*
+ *  Sets the glob patterns of the files and directories to skip, matched like the include patterns.
+ *  An excluded directory isn't walked at all.
+ */
+void DirectoryWalker::setExcludePatterns(const QStringList& patterns)
+{
+    _excludePatterns = toWildcards(patterns);
+}
+
+
+/*
+ *  Walks all the directories, in order, and closes the queue when done
+ */
+void DirectoryWalker::run()
+{
+    foreach (const QString& directory, _directories) {
+        if (!walk(QDir(directory), QString()))
+            break;
+    }
+
+    _queue.close();
+}
+
+
+/*
+ *  Adds the matching files of [directory] to the queue, and then walks its subdirectories.
+ *  The entries are sorted on name, which makes the order of the files the same on every run.
+ *  Returns false if the queue was closed by the parser, which means the walk should stop.
+ */
+bool DirectoryWalker::walk(const QDir& directory, const QString& relativePath)
+{
+    QFileInfoList entries = directory.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot,
+                                                    QDir::Name | QDir::DirsLast);
+
+    foreach (const QFileInfo& entry, entries) {
+        QString entryPath = relativePath.isEmpty() ? entry.fileName() : relativePath + '/' + entry.fileName();
+
+        if (matchesAny(_excludePatterns, entryPath))
+            continue;
+
+        if (entry.isDir()) {
+            // Symbolic links to directories aren't followed, they could make the walk go on forever
+            if (entry.isSymLink())
+                continue;
+
+            if (!walk(QDir(entry.filePath()), entryPath))
+                return false;
+        }
+        else if (_extensions.contains(entry.suffix(), Qt::CaseInsensitive)) {
+            if (!_includePatterns.isEmpty() && !matchesAny(_includePatterns, entryPath))
+                continue;
+
+            if (!_queue.enqueue(entry.filePath()))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ *  Returns true if any of the patterns matches the path (patterns with a '/')
+ *  or the last part of the path (patterns without a '/')
+ */
+bool DirectoryWalker::matchesAny(const QList<QRegExp>& patterns, const QString& relativePath) const
+{
+    QString fileName = relativePath.section('/', -1);
+
+    foreach (const QRegExp& pattern, patterns) {
+        if (pattern.exactMatch(pattern.pattern().contains('/') ? relativePath : fileName))
+            return true;
+    }
+
+    return false;
+}
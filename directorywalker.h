@@ -0,0 +1,44 @@
+/*
+ * directorywalker.h
+ *
+ * DirectoryWalker walks directories recursively on a thread of its own, adding the files
+ * with matching extensions and glob patterns to a FileNameQueue. This lets the parser start
+ * on the first files while the rest of the directory tree is still being listed.
+ */
+
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <QThread>
+#include <QList>
+#include <QRegExp>
+#include <QStringList>
+
+class QDir;
+class FileNameQueue;
+
+class DirectoryWalker : public QThread
+{
+    Q_OBJECT
+
+public:
+    DirectoryWalker(const QStringList& directories, const QStringList& extensions, FileNameQueue& queue, QObject* parent = 0);
+
+    void setIncludePatterns(const QStringList& patterns);
+    void setExcludePatterns(const QStringList& patterns);
+
+protected:
+    void run();
+
+private:
+    bool walk(const QDir& directory, const QString& relativePath);
+    bool matchesAny(const QList<QRegExp>& patterns, const QString& relativePath) const;
+
+    QStringList _directories;
+    QStringList _extensions;
+    QList<QRegExp> _includePatterns;
+    QList<QRegExp> _excludePatterns;
+    FileNameQueue& _queue;
+};
+
+#endif // DIRECTORYWALKER_H
@@ -1,21 +1,20 @@
 #include "distrshapepositioncalc.h"
-#include "nodeitem.h"
+#include "nodegraph.h"
 #include <qmath.h>
 #include <QDebug>
+#include <QPair>
+#include <QQueue>
 
 
 // Define some constants for ease of use when tweaking and debugging
 static const int DISTR_SHAPE_MIN_RADIUS = 90;
 static const int DISTR_SHAPE_RADIUS_INC_PER_ITEM = 10;
 static const int DISTR_SHAPE_ARC_DEGREES = 120;
-static const int DISTR_SHAPE_WIDTH_MOD = 100;
-static const int DISTR_SHAPE_HEIGHT_MOD = 100;
 
 /*
  *  Constructor
  */
-DistrShapePositionCalc::DistrShapePositionCalc(QList<NodeItem*>& nodelist)
-    : AbstractNodeItemPositionCalc(nodelist)
+DistrShapePositionCalc::DistrShapePositionCalc()
 {
 }
 
@@ -25,10 +24,9 @@ DistrShapePositionCalc::DistrShapePositionCalc(QList<NodeItem*>& nodelist)
  *  At the current stage, it just positions them in a circle and spreads the nodes
  *  with many children in a roughly even manner.
  *
- *  Call this:
- *  1) In the beginning when all nodes have been added from parsing the file(s)
- *  2) If a new node is added to an already created model. (Editable model not implemented yet!)
- *     Also make sure to call moveTo([new position]) afterwards.
+ *  Call this in the beginning when all nodes have been added from parsing the file(s).
+ *  Nodes added or changed later are placed without calculating all positions again,
+ *  see placeNodes() and relaxNodes().
  */
 void DistrShapePositionCalc::calculate()
 {
@@ -36,83 +34,75 @@ void DistrShapePositionCalc::calculate()
 }
 
 
-/*
- *  Utility comparator function that helps sort the connections list in
- *  distributedShape() in falling order on the number of connection for
- *  each node name.
- */
-static bool sortConnListLessThan(const QPair<QString, int>& one, const QPair<QString, int>& two) {
-    return one.second > two.second;     // 'More than' achieves falling order sorting
-}
-
 /*
  *  This function creates the shape for the node map using the following algorithm:
  *
- *  1. Create a hashmap of all the items
- *  2. Count all links to each item, both to and from
- *  3. Create a list sorted by the number of links
- *  4. For the item with most links:
+ *  1. Count all links to each item, both to and from
+ *  2. For the item with most links:
  *       - place it in the center
- *           - if there are more than one with the same number of node, choose one of them
+ *           - if there are more than one with the same number of links, the first one in the list is chosen
  *       - place other items around it, determined by:
  *           - all the items that connect to the center one
- *  5. For all other items:
- *       - unless the child has already been placed, place it in:
- *           - a fan shape (~120 degr), facing away from the parent
+ *  3. For all other items, breadth first from the center:
+ *       - unless the item has already been placed, place it in:
+ *           - a fan shape (~120 degr), facing away from the item it's connected to
+ *
+ *  The items waiting for their connected items to be placed are kept in a queue, and the placed
+ *  items in a bit array by row, so the whole shape takes time in proportion to the number of
+ *  items and links, and any depth of connections is handled without recursion.
  */
 void DistrShapePositionCalc::distributedShape()
 {
-    // Create a hashmap of all the items (uses hash at this stage to ease access to items)
-    QHash<QString, int> linkHash;
+    if (_graph->nodeCount() == 0)
+        return;
 
-    foreach(NodeItem* item, _nodelist) {
-        linkHash.insert(item->name(), 0);
-    }
+    _placedNodes.fill(false, _graph->nodeCount());
 
-    // Count all links to each item, both to and from
-    foreach (NodeItem* item, _nodelist) {
-        int itemsChildrenCount = linkHash.value(item->name());
-        linkHash.insert(item->name(), itemsChildrenCount + item->childCount());
+    // Find the item with most links, both to and from it
+    int centralRow = 0;
+    int mostLinks = -1;
 
-        QList<NodeItem*> childlist = item->children();
+    for (int row = 0; row < _graph->nodeCount(); ++row) {
+        const int links = _graph->childCount(row) + _graph->parentCount(row);
 
-        foreach (NodeItem* child, childlist) {
-            int childsChildrenCount = linkHash.value(child->name());
-            linkHash.insert(child->name(), childsChildrenCount + 1);
+        if (links > mostLinks) {
+            centralRow = row;
+            mostLinks = links;
         }
     }
 
-    // Create a list sorted by the number of links (use a list(pairs) at this stage to enable sorting)
-    QList<QPair<QString, int> > connCountList;
-
-    QHashIterator<QString, int> hashIter(linkHash);
-    while (hashIter.hasNext()) {
-        hashIter.next();
-        connCountList.append(qMakePair(hashIter.key(), hashIter.value()));
-    }
-
-    qSort(connCountList.begin(), connCountList.end(), sortConnListLessThan);
-
     // For the item with most links:
     //  - place it in the center
-    NodeItem* centralNode = getNode(connCountList.at(0).first);
-    centralNode->setPosition(_centerPoint);
-    alreadyPlacedNodes.append(centralNode);
+    _graph->setPosition(centralRow, _centerPoint);
+    _placedNodes.setBit(centralRow);
 
-    QList<NodeItem*> connectedNodes = getAllConnectedNodes(centralNode->name());
+    QList<int> connectedRows = takeUnplacedNodes(centralRow);
 
     // TODO Perhaps add some code to this section to allow for more than one centrally
     // placed node if more than one compete of that position
 
     //  - place other items around it, determined by:
     //      - all the items that connect to the center one
-    placeConnNodesCircle(centralNode, connectedNodes);
+    placeConnNodesCircle(centralRow, connectedRows);
 
     // For all other items:
-    //  - unless the child has already been placed, place it in:
-    //      - a fan shape (~120 degr), facing away from the parent
-    foreach (NodeItem* node, connectedNodes) {
-        placeConnNodesArc(node, centralNode);
+    //  - unless the item has already been placed, place it in:
+    //      - a fan shape (~120 degr), facing away from the item it's connected to
+    QQueue<QPair<int, int> > pendingNodes;          // The row of a placed node, and of the node it was placed around
+
+    foreach (int row, connectedRows) {
+        pendingNodes.enqueue(qMakePair(row, centralRow));
+    }
+
+    while (!pendingNodes.isEmpty()) {
+        const QPair<int, int> pending = pendingNodes.dequeue();
+
+        connectedRows = takeUnplacedNodes(pending.first);
+        placeConnNodesArc(pending.first, pending.second, connectedRows);
+
+        foreach (int row, connectedRows) {
+            pendingNodes.enqueue(qMakePair(row, pending.first));
+        }
     }
 
     // Calculate the current geometric size of the node map
@@ -120,139 +110,91 @@ void DistrShapePositionCalc::distributedShape()
 }
 
 /*
- *  Returns the node with the name passed along.
- *  If not found, NULL is returned.
+ *  Returns the rows of the nodes connected to the one in [row] that haven't been placed yet, and
+ *  marks them as placed. This includes both its children and nodes who count it as their child,
+ *  each node once.
  */
-NodeItem* DistrShapePositionCalc::getNode(const QString &nodeName)
+QList<int> DistrShapePositionCalc::takeUnplacedNodes(int row)
 {
-    for (int i = 0; i < _nodelist.size(); ++i) {
-        if (_nodelist[i]->name() == nodeName)
-            return _nodelist[i];
+    QList<int> connectedRows;
+
+    for (int edge = _graph->childBegin(row); edge < _graph->childEnd(row); ++edge) {
+        const int child = _graph->childRow(edge);
+
+        if (!_placedNodes.testBit(child)) {
+            _placedNodes.setBit(child);
+            connectedRows.append(child);
+        }
     }
-    return NULL;
-}
 
-/*
- *  Returns a list with all the nodes that are connected to the node with the name [nodeName].
- *  This includes both its children and nodes who counts [nodeName] as its parent.
- */
-QList<NodeItem*> DistrShapePositionCalc::getAllConnectedNodes(const QString& nodeName)
-{
-    QList<NodeItem*> connectedNodes;
-
-    NodeItem* nodeToInvestigate = getNode(nodeName);
-
-    // Add the node's children as connected nodes
-    connectedNodes += nodeToInvestigate->children();
-
-    // For each of the nodes in the _nodelist ... (except itself)
-    foreach (NodeItem* node, _nodelist) {
-        if (node == nodeToInvestigate)
-            continue;
-        // ... see if its children count [nodeToInvestigate] as its child
-        foreach (NodeItem* child, node->children()) {
-            if (child == nodeToInvestigate) {
-                connectedNodes.append(node);
-            }
+    for (int edge = _graph->parentBegin(row); edge < _graph->parentEnd(row); ++edge) {
+        const int parent = _graph->parentRow(edge);
+
+        if (!_placedNodes.testBit(parent)) {
+            _placedNodes.setBit(parent);
+            connectedRows.append(parent);
         }
     }
 
-    return connectedNodes;
+    return connectedRows;
 }
 
 /*
- *  Places the nodes connected to [centerNode] around it in a circle.
- *  Every node that gets its position is added to the exclusion list (alreadyPlacedNodes).
+ *  Places the nodes in [connectedRows] around the one in [centerRow] in a circle
  */
-void DistrShapePositionCalc::placeConnNodesCircle(const NodeItem* centerNode, QList<NodeItem*>& connectedNodes)
+void DistrShapePositionCalc::placeConnNodesCircle(int centerRow, const QList<int>& connectedRows)
 {
-    removePlacedNodes(connectedNodes);
-
-    int radius = radiusCircle(connectedNodes.size());
+    int radius = radiusCircle(connectedRows.size());
 
-    qreal betweenNodesRad = (M_PI / 180.0) * (360.0 / connectedNodes.size());
-    QPoint center = centerNode->position();
+    qreal betweenNodesRad = (M_PI / 180.0) * (360.0 / connectedRows.size());
+    QPoint center = _graph->position(centerRow);
     int xpos, ypos;
 
     // Set the coords for all nodes, circle wise around (0,0)
     // Note that the positions will need to be translated later during painting
-    for (int i = 0; i < connectedNodes.size(); ++i) {
+    for (int i = 0; i < connectedRows.size(); ++i) {
         xpos = radius * qCos(betweenNodesRad * i);      // cos v = x / r <=> x = r * cos v
         ypos = radius * qSin(betweenNodesRad * i);      // sin v = y / r <=> y = r * sin v
-        connectedNodes[i]->setPosition(QPoint(center.x() + xpos, center.y() + ypos));
-        alreadyPlacedNodes.append(connectedNodes.at(i));
+        _graph->setPosition(connectedRows.at(i), QPoint(center.x() + xpos, center.y() + ypos));
     }
 }
 
 /*
- *  Recursive function that calculates and sets the positions of all the nodes connected to the [centerNode]
- *  except for those nodes who are already placed. Every node that gets its position is added to the exclusion
- *  list (alreadyPlacedNodes), and then this function is called for that node as [centerNode].
+ *  Places the nodes in [connectedRows] in an arc around the one in [centerRow], facing away from
+ *  the one in [centerParentRow] (the node it was placed around). The nodes are all placed before
+ *  any of their own connected nodes are, which fixes the old BUG #100 where nodes placed by the
+ *  recursion were moved again by the arc they were first found in.
  */
-void DistrShapePositionCalc::placeConnNodesArc(const NodeItem* centerNode, const NodeItem* centerNodesParent)
+void DistrShapePositionCalc::placeConnNodesArc(int centerRow, int centerParentRow, const QList<int>& connectedRows)
 {
-    QList<NodeItem*> connectedNodes = getAllConnectedNodes(centerNode->name());
-
-    // Remove all the nodes that have already been placed from the passed along list
-    removePlacedNodes(connectedNodes);
-
     // If the list is empty, stop here
-    if (connectedNodes.isEmpty()) {
+    if (connectedRows.isEmpty()) {
         return;
     }
 
     // Calculate the radius of the arc with this number of nodes
-    int radius = radiusArc(connectedNodes.size());
+    int radius = radiusArc(connectedRows.size());
 
     // Get the angle from this node's parent to the current node itself
-    qreal centerAngleRad = getRadAngle(centerNodesParent->position(), centerNode->position());
+    qreal centerAngleRad = getRadAngle(_graph->position(centerParentRow), _graph->position(centerRow));
 
     // Modify the start point of the angle using half the arc angle and the center angle just retrieved
     qreal startAngelRad = centerAngleRad + (M_PI / 180.0) * (DISTR_SHAPE_ARC_DEGREES / 2);
 
     // Calculate the angle width between nodes, in radians
     // Divide the total arc angle with the number of nodes plus one (this centers the spread)
-    qreal betweenNodesRad = (M_PI / 180.0) * (static_cast<qreal>(DISTR_SHAPE_ARC_DEGREES) / (connectedNodes.size() + 1));
-
-    //qDebug() << centerAngleRad << "rad =" << centerAngleRad * (180.0 / M_PI) << "degr";
-    //qDebug() << startAngelRad << "rad =" << startAngelRad * (180.0 / M_PI) << "degr";
-    //qDebug() << radiansBetweenNodes << "rad =" << radiansBetweenNodes * (180.0 / M_PI) << "degr";
+    qreal betweenNodesRad = (M_PI / 180.0) * (static_cast<qreal>(DISTR_SHAPE_ARC_DEGREES) / (connectedRows.size() + 1));
 
-    QPoint center = centerNode->position();
+    QPoint center = _graph->position(centerRow);
     int xpos, ypos;
     qreal angle;
 
-    // For each connected node, calculate it's position. Then run this function recursively on the that node.
-    for (int i = 0; i < connectedNodes.size(); ++i) {                   // BUG #100: SIZE MIGHT DECREASE AS OTHER NODES ARE PLACED ON RECURSIE CALLS
+    // For each connected node, calculate it's position
+    for (int i = 0; i < connectedRows.size(); ++i) {
         angle = startAngelRad - (betweenNodesRad * (i + 1));
         xpos = radius * qCos(angle);                    // cos v = x / r <=> x = r * cos v
         ypos = radius * qSin(angle);                    // sin v = y / r <=> y = r * sin v
-        connectedNodes[i]->setPosition(QPoint(center.x() + xpos, center.y() + ypos));
-
-        //qDebug() << angle << "rad =" << angle * (180.0 / M_PI) << "degr";
-
-        // Add the node to the list of the already placed ones, to avoid it from
-        alreadyPlacedNodes.append(connectedNodes.at(i));
-
-        // Continue recursively on all connected nodes
-        placeConnNodesArc(connectedNodes.at(i), centerNode);
-    }
-
-    // SOLUTION? TO BUG #100: Place all connected nodes in the for-loop above in a container
-    // instead of calling placeConnNodesArc() on them in the loop. After this loop, create
-    // another for-loop and in there call placeConnNodesArc() on the once stored in the container.
-}
-
-/*
- *  Removes all nodes from the list which have already been placed,
- *  to avoid duplicate nodes or "stolen" nodes
- */
-void DistrShapePositionCalc::removePlacedNodes(QList<NodeItem*>& list)
-{
-    foreach (NodeItem* node, list) {
-        if (alreadyPlacedNodes.contains(node)) {
-            list.removeOne(node);
-        }
+        _graph->setPosition(connectedRows.at(i), QPoint(center.x() + xpos, center.y() + ypos));
     }
 }
 
@@ -314,53 +256,3 @@ qreal DistrShapePositionCalc::getRadAngle(const QPoint &from, const QPoint &to)
 
     return angleRad;
 }
-
-/*
- *  Calculates the width and height of the model by looking at
- *  the positions of all the nodes, finding the outermost ones.
- *  Adds a bit space around it determined by DISTR_SHAPE_WIDTH_MOD
- *  and DISTR_SHAPE_HEIGHT_MOD
- */
-void DistrShapePositionCalc::calculateCurrentSize()
-{
-    // Store some default, always to be over-written values
-    int maxX = INT_MIN, minX = INT_MAX,
-        maxY = INT_MIN, minY = INT_MAX;
-
-    // Look at each node's position and modify the max/min values if greater/lesser
-    foreach (NodeItem* node, _nodelist) {
-        QPoint nodepos = node->position();
-
-        if (nodepos.x() > maxX)
-            maxX = nodepos.x();
-        if (nodepos.x() < minX)
-            minX = nodepos.x();
-        if (nodepos.y() > maxY)
-            maxY = nodepos.y();
-        if (nodepos.y() < minY)
-            minY = nodepos.y();
-    }
-
-    // Add some extra space around the "node map"
-    minX -= DISTR_SHAPE_WIDTH_MOD;
-    maxX += DISTR_SHAPE_WIDTH_MOD;
-    minY -= DISTR_SHAPE_HEIGHT_MOD;
-    maxY += DISTR_SHAPE_HEIGHT_MOD;
-
-    int width = (maxX - minX);
-    int height = (maxY - minY);
-
-    QSize newSize(width, height);
-
-    // As the "node map" won't be perfectly centered at the origin, calculate a new center point
-    QPoint newCenter(minX + (width / 2), minY + (height / 2));
-
-    _currentSize = newSize;
-    _centerPoint = newCenter;
-
-    // Move the "node map" to center around the weighted center
-    moveInto(_centerPoint);
-
-//    _nodelist.append(new NodeItem(_nodelist.size(), "CENTER"));
-//    _nodelist.at(_nodelist.size()-1)->setPosition(_centerPoint);
-}
@@ -0,0 +1,115 @@
+#include "filenamequeue.h"
+
+/*
+ *  Constructor
+ */
+FileNameQueue::FileNameQueue()
+    : _closed(false)
+{
+}
+
+
+/*
+ *  Adds a file name, with the context to parse it in, to the end of the queue.
+ *  Returns false if the queue has been closed, in which case the name isn't added
+ *  and the producer should stop.
+ */
+bool FileNameQueue::enqueue(const QString& fileName, int context)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_closed)
+        return false;
+
+    _fileNames.enqueue(qMakePair(fileName, context));
+    _changed.wakeOne();
+
+    return true;
+}
+
+
+/*
+ *  Takes the first file name in the queue, waiting for one to be added if the queue is empty.
+ *  Its context is returned in [context], if set.
+ *  Returns false when the queue is closed and there are no more names to take.
+ */
+bool FileNameQueue::dequeue(QString& fileName, int* context)
+{
+    QMutexLocker locker(&_mutex);
+
+    while (_fileNames.isEmpty() && !_closed)
+        _changed.wait(&_mutex);
+
+    if (_fileNames.isEmpty())
+        return false;
+
+    takeFirst(fileName, context);
+
+    return true;
+}
+
+
+/*
+ *  Takes the first file name in the queue, without waiting.
+ *  Returns false if the queue is currently empty.
+ */
+bool FileNameQueue::tryDequeue(QString& fileName, int* context)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_fileNames.isEmpty())
+        return false;
+
+    takeFirst(fileName, context);
+
+    return true;
+}
+
+
+/*
+ *  Closes the queue. No more names can be added, but the ones already
+ *  in the queue can still be taken.
+ */
+void FileNameQueue::close()
+{
+    QMutexLocker locker(&_mutex);
+
+    _closed = true;
+    _changed.wakeAll();
+}
+
+
+/*
+ *  Returns true if the queue has been closed
+ */
+bool FileNameQueue::isClosed() const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _closed;
+}
+
+
+/*
+ *  Returns true if the queue has been closed and all names have been taken
+ */
+bool FileNameQueue::isFinished() const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _closed && _fileNames.isEmpty();
+}
+
+
+/*
+ *  Utility function that takes the first name and context in the queue. The mutex must be locked.
+ */
+void FileNameQueue::takeFirst(QString& fileName, int* context)
+{
+    QPair<QString, int> first = _fileNames.dequeue();
+
+    fileName = first.first;
+
+    if (context != 0)
+        *context = first.second;
+}
@@ -0,0 +1,42 @@
+/*
+ * filenamequeue.h
+ *
+ * FileNameQueue is a thread-safe queue of the names of the files to parse.
+ * Producers (e.g. the DirectoryWalker) add file names while the parser takes them,
+ * until the queue is closed and empty.
+ * Each file name may have a context, a parser specific id of how to parse the file
+ * (e.g. the compiler flags of a C++ file), see AbstractNodeParser::parseFile().
+ */
+
+#ifndef FILENAMEQUEUE_H
+#define FILENAMEQUEUE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QPair>
+#include <QString>
+
+class FileNameQueue
+{
+public:
+    FileNameQueue();
+
+    bool enqueue(const QString& fileName, int context = 0);
+    bool dequeue(QString& fileName, int* context = 0);
+    bool tryDequeue(QString& fileName, int* context = 0);
+
+    void close();
+    bool isClosed() const;
+    bool isFinished() const;
+
+private:
+    void takeFirst(QString& fileName, int* context);
+
+    mutable QMutex _mutex;
+    QWaitCondition _changed;
+    QQueue<QPair<QString, int> > _fileNames;
+    bool _closed;
+};
+
+#endif // FILENAMEQUEUE_H
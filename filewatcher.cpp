@@ -0,0 +1,78 @@
+#include "filewatcher.h"
+#include "abstractnodeparser.h"
+#include "nodeitemmodel.h"
+#include <QFileInfo>
+#include <QSet>
+
+static const int CHANGE_DELAY_MS = 50;      // Time to wait for more changes before updating
+
+
+/*
+ *  Constructor
+ *  The [parser] must have recorded the files it parsed (see AbstractNodeParser::setRecordParsedFiles()).
+ */
+FileWatcher::FileWatcher(AbstractNodeParser* parser, NodeItemModel* model, QObject* parent)
+    : QObject(parent), _parser(parser), _model(model)
+{
+    _delayTimer.setSingleShot(true);
+    _delayTimer.setInterval(CHANGE_DELAY_MS);
+
+    connect(&_watcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged(QString)));
+    connect(&_delayTimer, SIGNAL(timeout()), this, SLOT(updateChangedFiles()));
+    connect(_model, SIGNAL(layoutFinished()), this, SLOT(updateChangedFiles()));
+}
+
+
+/*
+ *  Starts watching the parsed files that aren't watched already
+ */
+void FileWatcher::watchParsedFiles()
+{
+    const QSet<QString> watchedFiles = QSet<QString>::fromList(_watcher.files());
+    QStringList newFiles;
+
+    foreach (const QString& fileName, _parser->parsedFiles()) {
+        if (!watchedFiles.contains(fileName) && QFileInfo(fileName).exists())
+            newFiles.append(fileName);
+    }
+
+    if (!newFiles.isEmpty())
+        _watcher.addPaths(newFiles);
+}
+
+
+/*
+ *  Called when a watched file is changed, removed or replaced.
+ *  The update is delayed a little, to take care of the changes coming after it at the same time.
+ */
+void FileWatcher::fileChanged(const QString& fileName)
+{
+    if (!_changedFiles.contains(fileName))
+        _changedFiles.append(fileName);
+
+    _delayTimer.start();
+}
+
+
+/*
+ *  Parses the changed files again and applies the changes of each to the model.
+ *  While the model's layout is running, the nodes can't be changed, so the changed files wait
+ *  for it to finish, when this is called again.
+ */
+void FileWatcher::updateChangedFiles()
+{
+    if (_changedFiles.isEmpty() || _model->isLayoutRunning())
+        return;
+
+    foreach (const QString& fileName, _changedFiles) {
+        NodeChanges changes;
+
+        if (_parser->reparseFile(fileName, changes) && !changes.isEmpty())
+            _model->applyChanges(changes);
+    }
+
+    _changedFiles.clear();
+
+    // Files replaced when saved aren't watched any more, and newly included files aren't watched yet
+    watchParsedFiles();
+}
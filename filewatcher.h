@@ -0,0 +1,43 @@
+/*
+ * filewatcher.h
+ *
+ * FileWatcher watches the parsed files once the view is open (inotify on Linux, through
+ * QFileSystemWatcher). When files change, only those files are parsed again, and the
+ * differences in nodes and edges are applied to the model, which tells the view.
+ * Changes coming close together (e.g. an editor saving in several steps) are handled at once,
+ * and changes coming while the model's layout is running wait for it to finish.
+ */
+
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QStringList>
+#include <QTimer>
+
+class AbstractNodeParser;
+class NodeItemModel;
+
+class FileWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileWatcher(AbstractNodeParser* parser, NodeItemModel* model, QObject* parent = 0);
+
+    void watchParsedFiles();
+
+private slots:
+    void fileChanged(const QString& fileName);
+    void updateChangedFiles();
+
+private:
+    AbstractNodeParser* _parser;
+    NodeItemModel* _model;
+    QFileSystemWatcher _watcher;
+    QTimer _delayTimer;
+    QStringList _changedFiles;
+};
+
+#endif // FILEWATCHER_H
@@ -0,0 +1,255 @@
+#include "forcekernel.h"
+#include <cstring>              // strcmp()
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FORCE_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(FORCE_KERNEL_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FORCE_KERNEL_AVX
+#include <immintrin.h>
+#endif
+
+static const int LANES = 8;         // The partial sums of every version, see reduce()
+
+typedef void (*RepulsionFunction)(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                                  int count, float minDistanceSquared, float& forceX, float& forceY);
+
+
+/*
+ *  Adds the push of point [i] to the partial sums [lane]: the point pushes by weight/d^2
+ *  along the line from it, d being the distance but at least the square root of
+ *  [minDistanceSquared].
+ */
+static inline void addPoint(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                            int i, float minDistanceSquared, float& sumX, float& sumY)
+{
+    const float dx = x - pointX[i];
+    const float dy = y - pointY[i];
+    float distanceSquared = dx * dx + dy * dy;
+
+    distanceSquared = distanceSquared > minDistanceSquared ? distanceSquared : minDistanceSquared;
+
+    const float push = weight[i] / distanceSquared;
+
+    sumX += dx * push;
+    sumY += dy * push;
+}
+
+
+/*
+ *  Adds up the partial sums pairwise, lane l with l + 4, then l with l + 2 and at last the two left
+ */
+static inline float reduce(const float* sums)
+{
+    const float half0 = sums[0] + sums[4], half1 = sums[1] + sums[5];
+    const float half2 = sums[2] + sums[6], half3 = sums[3] + sums[7];
+
+    return (half0 + half2) + (half1 + half3);
+}
+
+
+/*
+ *  The plain version, for CPUs without SSE2
+ */
+static void repulsionScalar(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                            int count, float minDistanceSquared, float& forceX, float& forceY)
+{
+    float sumsX[LANES] = { 0.0f }, sumsY[LANES] = { 0.0f };
+    int i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            addPoint(x, y, pointX, pointY, weight, i + lane, minDistanceSquared, sumsX[lane], sumsY[lane]);
+        }
+    }
+
+    float totalX = reduce(sumsX), totalY = reduce(sumsY);
+
+    for (; i < count; ++i) {
+        addPoint(x, y, pointX, pointY, weight, i, minDistanceSquared, totalX, totalY);
+    }
+
+    forceX += totalX;
+    forceY += totalY;
+}
+
+
+#ifdef FORCE_KERNEL_SSE2
+
+/*
+ *  Adds up the partial sums in [low] (lanes 0-3) and [high] (lanes 4-7) as reduce() does
+ */
+static inline float reduceSse(__m128 low, __m128 high)
+{
+    const __m128 halves = _mm_add_ps(low, high);
+    const __m128 quarters = _mm_add_ps(halves, _mm_movehl_ps(halves, halves));
+
+    return _mm_cvtss_f32(_mm_add_ss(quarters, _mm_shuffle_ps(quarters, quarters, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+
+
+/*
+ *  Adds the push of the 4 points from [i] to the partial sums
+ */
+static inline void addPointsSse(__m128 x, __m128 y, const float* pointX, const float* pointY, const float* weight,
+                                int i, __m128 minDistanceSquared, __m128& sumX, __m128& sumY)
+{
+    const __m128 dx = _mm_sub_ps(x, _mm_loadu_ps(pointX + i));
+    const __m128 dy = _mm_sub_ps(y, _mm_loadu_ps(pointY + i));
+    const __m128 distanceSquared = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), minDistanceSquared);
+    const __m128 push = _mm_div_ps(_mm_loadu_ps(weight + i), distanceSquared);
+
+    sumX = _mm_add_ps(sumX, _mm_mul_ps(dx, push));
+    sumY = _mm_add_ps(sumY, _mm_mul_ps(dy, push));
+}
+
+
+/*
+ *  The SSE2 version, two sets of 4 lanes
+ */
+static void repulsionSse(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                         int count, float minDistanceSquared, float& forceX, float& forceY)
+{
+    const __m128 xs = _mm_set1_ps(x), ys = _mm_set1_ps(y);
+    const __m128 minDistancesSquared = _mm_set1_ps(minDistanceSquared);
+    __m128 lowX = _mm_setzero_ps(), highX = _mm_setzero_ps();
+    __m128 lowY = _mm_setzero_ps(), highY = _mm_setzero_ps();
+    int i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        addPointsSse(xs, ys, pointX, pointY, weight, i, minDistancesSquared, lowX, lowY);
+        addPointsSse(xs, ys, pointX, pointY, weight, i + 4, minDistancesSquared, highX, highY);
+    }
+
+    float totalX = reduceSse(lowX, highX), totalY = reduceSse(lowY, highY);
+
+    for (; i < count; ++i) {
+        addPoint(x, y, pointX, pointY, weight, i, minDistanceSquared, totalX, totalY);
+    }
+
+    forceX += totalX;
+    forceY += totalY;
+}
+
+#endif // FORCE_KERNEL_SSE2
+
+
+#ifdef FORCE_KERNEL_AVX
+
+/*
+ *  The AVX version, one set of 8 lanes. Only called when the CPU has AVX.
+ */
+__attribute__((target("avx")))
+static void repulsionAvx(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                         int count, float minDistanceSquared, float& forceX, float& forceY)
+{
+    const __m256 xs = _mm256_set1_ps(x), ys = _mm256_set1_ps(y);
+    const __m256 minDistancesSquared = _mm256_set1_ps(minDistanceSquared);
+    __m256 sumX = _mm256_setzero_ps(), sumY = _mm256_setzero_ps();
+    int i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        const __m256 dx = _mm256_sub_ps(xs, _mm256_loadu_ps(pointX + i));
+        const __m256 dy = _mm256_sub_ps(ys, _mm256_loadu_ps(pointY + i));
+        const __m256 distanceSquared = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                     minDistancesSquared);
+        const __m256 push = _mm256_div_ps(_mm256_loadu_ps(weight + i), distanceSquared);
+
+        sumX = _mm256_add_ps(sumX, _mm256_mul_ps(dx, push));
+        sumY = _mm256_add_ps(sumY, _mm256_mul_ps(dy, push));
+    }
+
+    float totalX = reduceSse(_mm256_castps256_ps128(sumX), _mm256_extractf128_ps(sumX, 1));
+    float totalY = reduceSse(_mm256_castps256_ps128(sumY), _mm256_extractf128_ps(sumY, 1));
+
+    for (; i < count; ++i) {
+        addPoint(x, y, pointX, pointY, weight, i, minDistanceSquared, totalX, totalY);
+    }
+
+    forceX += totalX;
+    forceY += totalY;
+}
+
+#endif // FORCE_KERNEL_AVX
+
+
+/*
+ *  Returns the fastest version the CPU runs
+ */
+static RepulsionFunction selectRepulsion()
+{
+#ifdef FORCE_KERNEL_AVX
+    __builtin_cpu_init();           // Called before the static constructors of libgcc may have run
+
+    if (__builtin_cpu_supports("avx"))
+        return repulsionAvx;
+#endif
+#ifdef FORCE_KERNEL_SSE2
+    return repulsionSse;
+#else
+    return repulsionScalar;
+#endif
+}
+
+static RepulsionFunction repulsionFunction = selectRepulsion();
+
+
+/*
+ *  Adds the push on a node at ([x], [y]) from the [count] points to ([forceX], [forceY]).
+ *  Point i pushes by weight[i]/d^2, d being its distance from the node, but at least the
+ *  square root of [minDistanceSquared].
+ */
+void ForceKernel::repulsion(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                            int count, float minDistanceSquared, float& forceX, float& forceY)
+{
+    repulsionFunction(x, y, pointX, pointY, weight, count, minDistanceSquared, forceX, forceY);
+}
+
+
+/*
+ *  Returns the name of the instruction set the kernel runs with: "avx", "sse2" or "scalar"
+ */
+const char* ForceKernel::instructionSet()
+{
+    if (repulsionFunction == repulsionScalar)
+        return "scalar";
+
+#ifdef FORCE_KERNEL_AVX
+    if (repulsionFunction == repulsionAvx)
+        return "avx";
+#endif
+
+    return "sse2";
+}
+
+
+/*
+ *  Makes the kernel run with the instruction set [name], "avx", "sse2" or "scalar".
+ *  Returns false, leaving it as it is, if the CPU (or the build) doesn't have it.
+ *  Mustn't be called while a layout is calculated.
+ */
+bool ForceKernel::setInstructionSet(const char* name)
+{
+    if (strcmp(name, "scalar") == 0) {
+        repulsionFunction = repulsionScalar;
+        return true;
+    }
+
+#ifdef FORCE_KERNEL_SSE2
+    if (strcmp(name, "sse2") == 0) {
+        repulsionFunction = repulsionSse;
+        return true;
+    }
+#endif
+
+#ifdef FORCE_KERNEL_AVX
+    if (strcmp(name, "avx") == 0 && __builtin_cpu_supports("avx")) {
+        repulsionFunction = repulsionAvx;
+        return true;
+    }
+#endif
+
+    return false;
+}
@@ -0,0 +1,28 @@
+/*
+ * forcekernel.h
+ *
+ * ForceKernel sums the push on a node from a list of points, the inner loop of the force
+ * layout. The points are kept in separate arrays of x, y and weight, so the sum is done
+ * 8 (AVX) or 4 (SSE2) points at a time where the CPU has it; which is picked when the
+ * program starts. All versions add the points up in the same order, 8 partial sums that
+ * are then added pairwise, so they give the same result to the last bit.
+ * Another version the CPU runs can be picked with setInstructionSet(), e.g. to compare them
+ * (see Benchmark).
+ */
+
+#ifndef FORCEKERNEL_H
+#define FORCEKERNEL_H
+
+class ForceKernel
+{
+public:
+    static void repulsion(float x, float y, const float* pointX, const float* pointY, const float* weight,
+                          int count, float minDistanceSquared, float& forceX, float& forceY);
+    static const char* instructionSet();
+    static bool setInstructionSet(const char* name);
+
+private:
+    ForceKernel();
+};
+
+#endif // FORCEKERNEL_H
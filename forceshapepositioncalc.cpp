@@ -0,0 +1,501 @@
+#include "forceshapepositioncalc.h"
+#include "forcekernel.h"
+#include "nodegraph.h"
+#include <QVarLengthArray>
+#include <qmath.h>
+
+// Define some constants for ease of use when tweaking and debugging
+static const qreal FORCE_SHAPE_NODE_DISTANCE = 120.0;      // The ideal length of an edge, k
+static const int FORCE_SHAPE_MAX_ITERATIONS = 300;
+static const qreal FORCE_SHAPE_CONVERGENCE = 0.5;          // Done when no node moves further than this in an iteration
+static const qreal FORCE_SHAPE_COOLING = 0.95;             // The largest move allowed shrinks by this every iteration
+static const qreal FORCE_SHAPE_THETA = 0.8;                // Cells smaller than this times their distance push as one node
+static const qreal FORCE_SHAPE_MIN_DISTANCE = 0.01;        // Nodes closer than this are pushed as if this far apart
+static const int QUADTREE_MAX_DEPTH = 32;                  // Nodes at the same spot share a cell at this depth
+static const int QUADTREE_LEAF_NODES = 16;                 // Cells with no more nodes than this aren't split
+static const int FORCE_SHAPE_CHUNK_SIZE = 256;             // The number of nodes a thread takes at a time
+
+/*
+ *  Constructor
+ */
+ForceShapePositionCalc::ForceShapePositionCalc()
+    : _maxIterations(FORCE_SHAPE_MAX_ITERATIONS),
+      _convergenceThreshold(FORCE_SHAPE_CONVERGENCE), _nodeDistance(FORCE_SHAPE_NODE_DISTANCE),
+      _pass(NULL), _temperature(0.0)
+{
+}
+
+/*
+ *  Calculates the positions of all nodes, centered around the origin
+ */
+void ForceShapePositionCalc::calculate()
+{
+    forceShape();
+}
+
+/*
+ *  Sets the largest number of iterations the layout runs, even if it hasn't settled
+ */
+void ForceShapePositionCalc::setMaxIterations(int iterations)
+{
+    _maxIterations = qMax(0, iterations);
+}
+
+/*
+ *  Sets how far the nodes may move at most in an iteration for the layout to be settled
+ */
+void ForceShapePositionCalc::setConvergenceThreshold(qreal distance)
+{
+    _convergenceThreshold = distance;
+}
+
+/*
+ *  Creates the node map:
+ *
+ *  1. Place the nodes in a spiral around the origin, in the order of the node list
+ *  2. Let the forces move the nodes until the layout settles, see settle()
+ *  3. Set the positions of the nodes and calculate the size of the node map
+ */
+void ForceShapePositionCalc::forceShape()
+{
+    if (_graph->nodeCount() == 0)
+        return;
+
+    collectGraph();
+
+    _nodeDistance = FORCE_SHAPE_NODE_DISTANCE;
+    spiralPositions();
+
+    // Start by allowing moves across a good part of the spiral, the layout is refined as it cools
+    settle(_nodeDistance * qMax(1.0, qSqrt(_graph->nodeCount()) / 4.0), _maxIterations, _convergenceThreshold);
+
+    applyPositions();
+    clearBuffers();
+
+    calculateCurrentSize();
+}
+
+/*
+ *  Collects the graph to lay out: the connected nodes of each node by row, as both ends of an
+ *  edge pull, all with mass and edge weight 1
+ */
+void ForceShapePositionCalc::collectGraph()
+{
+    collectNeighbours(_neighbourOffsets, _neighbours);
+
+    _masses.fill(1.0f, _graph->nodeCount());
+    _neighbourWeights.fill(1.0f, _neighbours.size());
+}
+
+/*
+ *  Places the nodes of the graph in a spiral around the origin, about a node distance apart.
+ *  The spiral doesn't depend on any earlier positions, so the same graph always gives the
+ *  same layout.
+ */
+void ForceShapePositionCalc::spiralPositions()
+{
+    const int count = _masses.size();
+
+    _x.resize(count);
+    _y.resize(count);
+
+    for (int row = 0; row < count; ++row) {
+        const qreal radius = _nodeDistance / 2.0 * qSqrt(row);
+        const qreal angle = row * GOLDEN_ANGLE;
+
+        _x[row] = radius * qCos(angle);
+        _y[row] = radius * qSin(angle);
+    }
+}
+
+/*
+ *  Lets the forces move the nodes of the graph from their current positions, for at most
+ *  [iterations] iterations or until no node moves further than [convergenceThreshold]:
+ *    - find how far the forces move each node (see iterate())
+ *    - move the nodes, but no further than the current "temperature"
+ *    - cool down, so the nodes move less for every iteration
+ *  The positions are published every few iterations when the graph is the one of the node list
+ *  (see AbstractNodeItemPositionCalc::snapshotDue()), and the moving stops when canceled.
+ */
+void ForceShapePositionCalc::settle(qreal temperature, int iterations, qreal convergenceThreshold)
+{
+    const int count = _x.size();
+
+    _displacementX.resize(count);
+    _displacementY.resize(count);
+    _chunkMoves.resize((count + FORCE_SHAPE_CHUNK_SIZE - 1) / FORCE_SHAPE_CHUNK_SIZE);
+
+    for (int i = 0; i < iterations; ++i) {
+        if (isCanceled())
+            break;
+
+        if (count == _graph->nodeCount() && snapshotDue(i))
+            publishSnapshot(positions());
+
+        if (iterate(temperature) < convergenceThreshold)
+            break;
+
+        temperature *= FORCE_SHAPE_COOLING;
+    }
+}
+
+/*
+ *  Sets the positions of the nodes in the graph to the calculated ones
+ */
+void ForceShapePositionCalc::applyPositions()
+{
+    const QVector<QPoint> points = positions();
+
+    for (int row = 0; row < _graph->nodeCount(); ++row) {
+        _graph->setPosition(row, points.at(row));
+    }
+}
+
+/*
+ *  Returns the calculated positions by row, rounded
+ */
+QVector<QPoint> ForceShapePositionCalc::positions() const
+{
+    QVector<QPoint> points(_x.size());
+
+    for (int row = 0; row < _x.size(); ++row) {
+        points[row] = QPoint(qRound(_x.at(row)), qRound(_y.at(row)));
+    }
+
+    return points;
+}
+
+/*
+ *  Frees the buffers, they are only needed while calculating
+ */
+void ForceShapePositionCalc::clearBuffers()
+{
+    _x.clear();
+    _y.clear();
+    _masses.clear();
+    _neighbourOffsets.clear();
+    _neighbours.clear();
+    _neighbourWeights.clear();
+    _displacementX.clear();
+    _displacementY.clear();
+    _cells.clear();
+    _cellBodies.clear();
+    _sortedBodies.clear();
+    _chunkMoves.clear();
+}
+
+/*
+ *  Runs one iteration of the layout: every node is pushed away from all others (approximated
+ *  with the quadtree) by k^2/d times the pushing node's mass, and connected nodes pull each
+ *  other by d^2/k times the edge's weight, where k is the ideal edge length and d the distance.
+ *  Each node is then moved in the direction of its total force, but no further than [temperature].
+ *  The quadtree is built on this thread, the forces and moves on all threads. All forces
+ *  are calculated before any node is moved.
+ *  Returns the longest distance a node was moved.
+ */
+qreal ForceShapePositionCalc::iterate(qreal temperature)
+{
+    buildQuadTree();
+
+    _temperature = temperature;
+
+    runParallel(&ForceShapePositionCalc::calculateForces);
+    runParallel(&ForceShapePositionCalc::moveNodes);
+
+    qreal longestMove = 0.0;
+
+    foreach (qreal move, _chunkMoves) {
+        longestMove = qMax(longestMove, move);
+    }
+
+    return longestMove;
+}
+
+/*
+ *  Runs [pass] over all nodes on all threads, a chunk of nodes per task (see runTasks()), so a
+ *  thread with slow chunks (e.g. nodes in a crowded part of the quadtree) doesn't hold the
+ *  others up. Returns when all chunks are done.
+ */
+void ForceShapePositionCalc::runParallel(Pass pass)
+{
+    _pass = pass;
+    runTasks(_chunkMoves.size());
+}
+
+/*
+ *  Runs the current pass on chunk [task] of the nodes
+ */
+void ForceShapePositionCalc::runTask(int task)
+{
+    const int begin = task * FORCE_SHAPE_CHUNK_SIZE;
+
+    (this->*_pass)(begin, qMin(begin + FORCE_SHAPE_CHUNK_SIZE, _x.size()));
+}
+
+/*
+ *  Calculates the total force on the nodes [begin, end): the push from all others, and the
+ *  pull of the connected ones. Each node's force is only written by the thread calculating it.
+ */
+void ForceShapePositionCalc::calculateForces(int begin, int end)
+{
+    PushingPoints points;
+    points.count = 0;
+
+    for (int body = begin; body < end; ++body) {
+        float forceX = 0.0f, forceY = 0.0f;
+
+        repulsion(body, points, forceX, forceY);
+
+        // A pull of d^2/k along the edge is the edge times d/k
+        for (int i = _neighbourOffsets.at(body); i < _neighbourOffsets.at(body + 1); ++i) {
+            const float dx = _x.at(body) - _x.at(_neighbours.at(i));
+            const float dy = _y.at(body) - _y.at(_neighbours.at(i));
+            const float distance = qMax(qSqrt(dx * dx + dy * dy), FORCE_SHAPE_MIN_DISTANCE);
+            const float pull = distance / _nodeDistance * _neighbourWeights.at(i);
+
+            forceX -= dx * pull;
+            forceY -= dy * pull;
+        }
+
+        _displacementX[body] = forceX;
+        _displacementY[body] = forceY;
+    }
+}
+
+/*
+ *  Moves the nodes [begin, end) in the direction of their force, but no further than the
+ *  temperature, and notes the longest move of the chunk
+ */
+void ForceShapePositionCalc::moveNodes(int begin, int end)
+{
+    const float temperature = _temperature;
+    float longestMove = 0.0f;
+
+    for (int body = begin; body < end; ++body) {
+        const float dx = _displacementX.at(body);
+        const float dy = _displacementY.at(body);
+        const float length = qSqrt(dx * dx + dy * dy);
+
+        if (length > 0.0f) {
+            const float move = qMin(length, temperature);
+
+            _x[body] += dx / length * move;
+            _y[body] += dy / length * move;
+            longestMove = qMax(longestMove, move);
+        }
+    }
+
+    _chunkMoves[begin / FORCE_SHAPE_CHUNK_SIZE] = longestMove;
+}
+
+/*
+ *  Builds the quadtree of the current positions, a square around all nodes as the root
+ */
+void ForceShapePositionCalc::buildQuadTree()
+{
+    const int count = _x.size();
+    float minX = _x.first(), maxX = minX;
+    float minY = _y.first(), maxY = minY;
+
+    for (int body = 0; body < count; ++body) {
+        minX = qMin(minX, _x.at(body));
+        maxX = qMax(maxX, _x.at(body));
+        minY = qMin(minY, _y.at(body));
+        maxY = qMax(maxY, _y.at(body));
+    }
+
+    QuadCell root;
+    root.x = minX;
+    root.y = minY;
+    root.size = qMax(maxX - minX, maxY - minY) + 1.0f;     // Keep the nodes on the far edges inside
+    root.children[0] = root.children[1] = root.children[2] = root.children[3] = -1;
+
+    _cells.resize(0);                   // Keeps the memory from the last iteration
+    _cells.append(root);
+
+    _cellBodies.resize(count);
+    _sortedBodies.resize(count);
+
+    for (int body = 0; body < count; ++body) {
+        _cellBodies[body] = body;
+    }
+
+    buildCell(0, 0, count, 0);
+}
+
+/*
+ *  Sets up [cell] with the nodes _cellBodies[begin, end), which are all inside it: their
+ *  number, mass and center of mass. A cell with more than a leaf's worth of nodes gets a cell for
+ *  each quarter holding any, with its nodes sorted by quarter so each quarter's nodes stay
+ *  one after another.
+ */
+void ForceShapePositionCalc::buildCell(int cell, int begin, int end, int depth)
+{
+    qreal mass = 0.0, massX = 0.0, massY = 0.0;
+
+    for (int i = begin; i < end; ++i) {
+        const int body = _cellBodies.at(i);
+
+        mass += _masses.at(body);
+        massX += _masses.at(body) * _x.at(body);
+        massY += _masses.at(body) * _y.at(body);
+    }
+
+    _cells[cell].centerX = massX / mass;
+    _cells[cell].centerY = massY / mass;
+    _cells[cell].mass = mass;
+    _cells[cell].count = end - begin;
+    _cells[cell].first = begin;
+
+    // Nodes at the same spot can't be split, let them share the cell at the bottom
+    if (end - begin <= QUADTREE_LEAF_NODES || depth >= QUADTREE_MAX_DEPTH)
+        return;
+
+    int quarterBegin[4] = { 0, 0, 0, 0 };
+    int quarterEnd[4];
+
+    for (int i = begin; i < end; ++i) {
+        ++quarterBegin[quarterOf(cell, _x.at(_cellBodies.at(i)), _y.at(_cellBodies.at(i)))];
+    }
+
+    // From the counts to where each quarter starts
+    for (int quarter = 0, start = begin; quarter < 4; ++quarter) {
+        const int quarterCount = quarterBegin[quarter];
+
+        quarterBegin[quarter] = quarterEnd[quarter] = start;
+        start += quarterCount;
+    }
+
+    for (int i = begin; i < end; ++i) {
+        const int body = _cellBodies.at(i);
+
+        _sortedBodies[quarterEnd[quarterOf(cell, _x.at(body), _y.at(body))]++] = body;
+    }
+
+    for (int i = begin; i < end; ++i) {
+        _cellBodies[i] = _sortedBodies.at(i);
+    }
+
+    for (int quarter = 0; quarter < 4; ++quarter) {
+        if (quarterEnd[quarter] > quarterBegin[quarter])
+            buildCell(addChildCell(cell, quarter), quarterBegin[quarter], quarterEnd[quarter], depth + 1);
+    }
+}
+
+/*
+ *  Returns the quarter of [cell] that ([x], [y]) is in: 0 top left, 1 top right,
+ *  2 bottom left and 3 bottom right
+ */
+int ForceShapePositionCalc::quarterOf(int cell, qreal x, qreal y) const
+{
+    const QuadCell& quadCell = _cells.at(cell);
+    const qreal half = quadCell.size / 2.0;
+
+    return (x >= quadCell.x + half ? 1 : 0) + (y >= quadCell.y + half ? 2 : 0);
+}
+
+/*
+ *  Adds an empty cell for the [quarter] of [cell], and returns it
+ */
+int ForceShapePositionCalc::addChildCell(int cell, int quarter)
+{
+    const qreal half = _cells.at(cell).size / 2.0;
+
+    QuadCell child;
+    child.x = _cells.at(cell).x + ((quarter & 1) ? half : 0.0);
+    child.y = _cells.at(cell).y + ((quarter & 2) ? half : 0.0);
+    child.size = half;
+    child.children[0] = child.children[1] = child.children[2] = child.children[3] = -1;
+
+    _cells.append(child);
+    _cells[cell].children[quarter] = _cells.size() - 1;
+
+    return _cells.size() - 1;
+}
+
+/*
+ *  Adds the total push on the node [body] from all other nodes to ([forceX], [forceY]), using
+ *  the quadtree: a cell that is small compared to its distance pushes as one node with the
+ *  cell's mass at its center of mass, otherwise its quarters are looked at instead,
+ *  or the nodes themselves for a leaf. The pushing cells and nodes are collected in [points]
+ *  and summed by ForceKernel.
+ */
+void ForceShapePositionCalc::repulsion(int body, PushingPoints& points, float& forceX, float& forceY) const
+{
+    static const qreal MIN_DISTANCE_SQUARED = FORCE_SHAPE_MIN_DISTANCE * FORCE_SHAPE_MIN_DISTANCE;
+
+    const qreal kSquared = _nodeDistance * _nodeDistance;
+    const qreal x = _x.at(body);
+    const qreal y = _y.at(body);
+    qreal coincidentMass = 0.0;         // The mass of the other nodes at the same spot
+    QVarLengthArray<int, 4 * QUADTREE_MAX_DEPTH> pendingCells;
+
+    points.count = 0;
+    pendingCells.append(0);
+
+    while (!pendingCells.isEmpty()) {
+        const QuadCell& cell = _cells.at(pendingCells.last());
+        pendingCells.removeLast();
+
+        const qreal distanceSquared = (x - cell.centerX) * (x - cell.centerX) + (y - cell.centerY) * (y - cell.centerY);
+
+        if (cell.size * cell.size < FORCE_SHAPE_THETA * FORCE_SHAPE_THETA * distanceSquared) {
+            points.append(cell.centerX, cell.centerY, kSquared * cell.mass);
+            continue;
+        }
+
+        const bool isLeaf = cell.children[0] < 0 && cell.children[1] < 0 && cell.children[2] < 0 && cell.children[3] < 0;
+
+        if (!isLeaf) {
+            for (int quarter = 0; quarter < 4; ++quarter) {
+                if (cell.children[quarter] >= 0)
+                    pendingCells.append(cell.children[quarter]);
+            }
+            continue;
+        }
+
+        for (int i = cell.first; i < cell.first + cell.count; ++i) {
+            const int other = _cellBodies.at(i);
+            const qreal otherX = _x.at(other);
+            const qreal otherY = _y.at(other);
+
+            if (other == body)
+                continue;
+
+            if ((x - otherX) * (x - otherX) + (y - otherY) * (y - otherY) < MIN_DISTANCE_SQUARED)
+                coincidentMass += _masses.at(other);
+            else
+                points.append(otherX, otherY, kSquared * _masses.at(other));
+        }
+    }
+
+    // Nodes on top of each other are pushed apart in a direction given by the node
+    if (coincidentMass > 0.0) {
+        const qreal push = kSquared * coincidentMass / FORCE_SHAPE_MIN_DISTANCE;
+
+        forceX += qCos(body * GOLDEN_ANGLE) * push;
+        forceY += qSin(body * GOLDEN_ANGLE) * push;
+    }
+
+    ForceKernel::repulsion(x, y, points.x.constData(), points.y.constData(), points.weight.constData(), points.count,
+                           MIN_DISTANCE_SQUARED, forceX, forceY);
+}
+
+/*
+ *  Adds a point pushing by [weight]/d^2, growing the arrays when they are full
+ */
+void ForceShapePositionCalc::PushingPoints::append(float pointX, float pointY, float pointWeight)
+{
+    if (count == x.size()) {
+        const int size = qMax(64, 2 * count);
+
+        x.resize(size);
+        y.resize(size);
+        weight.resize(size);
+    }
+
+    x[count] = pointX;
+    y[count] = pointY;
+    weight[count] = pointWeight;
+    ++count;
+}
@@ -0,0 +1,111 @@
+/*
+ * forceshapepositioncalc.h
+ *
+ * This class calculates the position of the nodes to be represented graphically in the view,
+ * using a force-directed layout in the style of Fruchterman and Reingold: all nodes push each
+ * other away, connected nodes pull each other together, and the nodes move a bit less for
+ * every iteration until the layout settles.
+ *
+ * The pushing between all nodes is approximated with a quadtree (Barnes-Hut): a group of
+ * nodes far enough away pushes like a single node at its center of mass, which makes each
+ * iteration O(n log n) instead of O(n^2).
+ *
+ * The forces and moves of an iteration are calculated on all cores: the nodes are split in
+ * chunks that the threads take one at a time until none are left. Each node's force is summed
+ * by the thread handling it, in the same order whatever the number of threads, so the layout
+ * is the same bit for bit however many threads calculated it.
+ *
+ * The positions and forces are kept in separate float arrays of x and y, and the quadtree
+ * walk for a node only collects the points pushing it: the centers of the far cells, and the
+ * nodes one by one of the near leaves, which hold up to 16 nodes each. The push of them all
+ * is then summed several points at a time by ForceKernel, with the widest vector
+ * instructions of the CPU.
+ */
+
+#ifndef FORCESHAPEPOSITIONCALC_H
+#define FORCESHAPEPOSITIONCALC_H
+
+#include "abstractnodeitempositioncalc.h"
+#include <QList>
+#include <QVector>
+
+class ForceShapePositionCalc : public AbstractNodeItemPositionCalc
+{
+public:
+    ForceShapePositionCalc();
+
+    virtual void calculate();
+
+    void setMaxIterations(int iterations);
+    void setConvergenceThreshold(qreal distance);
+
+protected:
+    int _maxIterations;
+    qreal _convergenceThreshold;
+    qreal _nodeDistance;                // The ideal length of an edge, k
+
+    // The graph being laid out: a node's pushing weighs as much as its mass, and an edge
+    // pulls as hard as its weight. Both are 1 for the nodes and edges of the node list.
+    QVector<float> _x;                  // The positions by row
+    QVector<float> _y;
+    QVector<float> _masses;
+    QVector<int> _neighbourOffsets;     // The rows of the connected nodes of each node, CSR style
+    QVector<int> _neighbours;
+    QVector<float> _neighbourWeights;   // The weight of the edge to each neighbour
+
+    void collectGraph();
+    void spiralPositions();
+    void settle(qreal temperature, int iterations, qreal convergenceThreshold);
+    QVector<QPoint> positions() const;
+    void applyPositions();
+    void clearBuffers();
+
+private:
+    typedef void (ForceShapePositionCalc::*Pass)(int begin, int end);
+
+    // A square of the quadtree, holding the number and center of mass of the nodes inside it
+    struct QuadCell {
+        qreal x, y, size;           // The top left corner and the side
+        qreal centerX, centerY;     // The center of mass of the nodes inside
+        qreal mass;                 // The total mass of the nodes inside
+        int count;
+        int first;                  // The nodes inside are _cellBodies[first, first + count)
+        int children[4];            // The cells of the quarters, -1 for empty ones or a leaf
+    };
+
+    // The points pushing a node, collected from the quadtree for ForceKernel.
+    // The arrays only grow; the first [count] entries are in use.
+    struct PushingPoints {
+        QVector<float> x, y;
+        QVector<float> weight;      // The mass of the nodes at the point times k^2
+        int count;
+
+        void append(float pointX, float pointY, float pointWeight);
+    };
+
+    QVector<float> _displacementX;      // The total force on each node in the current iteration
+    QVector<float> _displacementY;
+    QVector<QuadCell> _cells;           // The quadtree, the root first
+    QVector<int> _cellBodies;           // The nodes sorted so each cell's are one after another
+    QVector<int> _sortedBodies;         // Space for sorting the nodes of a cell by quarter
+
+    Pass _pass;                         // The pass run by the tasks, see runParallel()
+    qreal _temperature;                 // The longest move allowed in the current iteration
+    QVector<qreal> _chunkMoves;         // The longest move in each chunk of nodes
+
+    void forceShape();
+    qreal iterate(qreal temperature);
+
+    void runParallel(Pass pass);
+    void runTask(int task);
+    void calculateForces(int begin, int end);
+    void moveNodes(int begin, int end);
+
+    void buildQuadTree();
+    void buildCell(int cell, int begin, int end, int depth);
+    int quarterOf(int cell, qreal x, qreal y) const;
+    int addChildCell(int cell, int quarter);
+    void repulsion(int body, PushingPoints& points, float& forceX, float& forceY) const;
+};
+
+#endif // FORCESHAPEPOSITIONCALC_H
@@ -0,0 +1,137 @@
+#include "includeresolver.h"
+#include <QFileInfo>
+#include <QDir>
+
+
+/*
+ *  Constructor
+ */
+IncludeResolver::IncludeResolver()
+{
+}
+
+
+/*
+ *  Adds a directory to search for files included with quotes only (like -iquote).
+ *  These directories are searched before the ones added by addIncludePath().
+ *  Must not be called while parsing is going on.
+ */
+void IncludeResolver::addQuoteIncludePath(const QString& path)
+{
+    QWriteLocker locker(&_lock);
+
+    _quoteIncludePaths.append(QDir(path).absolutePath());
+    _resolved.clear();
+}
+
+
+/*
+ *  Adds a directory to search for included files (like -I), searched in the order added.
+ *  Must not be called while parsing is going on.
+ */
+void IncludeResolver::addIncludePath(const QString& path)
+{
+    QWriteLocker locker(&_lock);
+
+    _includePaths.append(QDir(path).absolutePath());
+    _resolved.clear();
+}
+
+
+/*
+ *  Adds a system directory to search for included files (like -isystem).
+ *  The system directories are searched after all the ones added by addIncludePath().
+ *  Must not be called while parsing is going on.
+ */
+void IncludeResolver::addSystemIncludePath(const QString& path)
+{
+    QWriteLocker locker(&_lock);
+
+    _systemIncludePaths.append(QDir(path).absolutePath());
+    _resolved.clear();
+}
+
+
+/*
+ *  Returns the canonical path of the file included as [spelling] (the text between the <> or ""),
+ *  or an empty string if it can't be found.
+ *  Quoted includes are first looked for in [includingDirectory], the directory of the including file,
+ *  and then in the quote include paths. Then the include paths are searched, followed by the system
+ *  include paths.
+ */
+QString IncludeResolver::resolve(const QString& spelling, bool quoted, const QString& includingDirectory)
+{
+    // The including file's directory only matters for quoted includes
+    QPair<QString, QString> key(quoted ? includingDirectory : QString(), spelling);
+
+    {
+        QReadLocker locker(&_lock);
+        QHash<QPair<QString, QString>, QString>::const_iterator it = _resolved.constFind(key);
+
+        if (it != _resolved.constEnd())
+            return it.value();
+    }
+
+    QString resolved;
+
+    if (QDir::isAbsolutePath(spelling))
+        resolved = canonicalPath(spelling);
+
+    if (resolved.isEmpty() && quoted)
+        resolved = canonicalPath(includingDirectory + '/' + spelling);
+
+    if (resolved.isEmpty() && quoted)
+        resolved = findInPaths(spelling, _quoteIncludePaths);
+
+    if (resolved.isEmpty())
+        resolved = findInPaths(spelling, _includePaths);
+
+    if (resolved.isEmpty())
+        resolved = findInPaths(spelling, _systemIncludePaths);
+
+    QWriteLocker locker(&_lock);
+    _resolved.insert(key, resolved);
+
+    return resolved;
+}
+
+
+/*
+ *  Returns the canonical path (absolute, without symbolic links, '.' or '..') of an existing file,
+ *  or an empty string if there's no such file. The result is cached, so the file system is only
+ *  asked once per path.
+ */
+QString IncludeResolver::canonicalPath(const QString& path)
+{
+    {
+        QReadLocker locker(&_lock);
+        QHash<QString, QString>::const_iterator it = _canonicalPaths.constFind(path);
+
+        if (it != _canonicalPaths.constEnd())
+            return it.value();
+    }
+
+    QFileInfo info(path);
+    QString canonical = info.isFile() ? info.canonicalFilePath() : QString();
+
+    QWriteLocker locker(&_lock);
+    _canonicalPaths.insert(path, canonical);
+
+    return canonical;
+}
+
+
+/*
+ *  Returns the canonical path of the first file found as [spelling] in [paths], or an empty string
+ */
+QString IncludeResolver::findInPaths(const QString& spelling, const QStringList& paths)
+{
+    foreach (const QString& path, paths) {
+        QString resolved = canonicalPath(path + '/' + spelling);
+
+        if (!resolved.isEmpty())
+            return resolved;
+    }
+
+    return QString();
+}
@@ -0,0 +1,47 @@
+/*
+ * includeresolver.h
+ *
+ * IncludeResolver finds the file on disk that an #include refers to, using the directory
+ * of the including file and the include search paths (-iquote, -I and -isystem), and returns its
+ * canonical path. That path is the identity of the file's node, so that two different
+ * files with the same name aren't merged into one node.
+ *
+ * All lookups are cached, both per (directory, spelling) and per path on disk, making
+ * repeated includes of the same file cost one hash lookup. The resolver is shared by
+ * the parsers on all worker threads, and is thread-safe once the search paths are set.
+ */
+
+#ifndef INCLUDERESOLVER_H
+#define INCLUDERESOLVER_H
+
+#include <QHash>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+
+class IncludeResolver
+{
+public:
+    IncludeResolver();
+
+    void addQuoteIncludePath(const QString& path);
+    void addIncludePath(const QString& path);
+    void addSystemIncludePath(const QString& path);
+
+    QString resolve(const QString& spelling, bool quoted, const QString& includingDirectory);
+    QString canonicalPath(const QString& path);
+
+private:
+    QString findInPaths(const QString& spelling, const QStringList& paths);
+
+    QStringList _quoteIncludePaths;
+    QStringList _includePaths;
+    QStringList _systemIncludePaths;
+
+    QReadWriteLock _lock;
+    QHash<QPair<QString, QString>, QString> _resolved;      // (directory, spelling) -> canonical path, empty if not found
+    QHash<QString, QString> _canonicalPaths;                // path -> canonical path, empty if not an existing file
+};
+
+#endif // INCLUDERESOLVER_H
@@ -0,0 +1,355 @@
+#include "layershapepositioncalc.h"
+#include "nodegraph.h"
+#include <QBitArray>
+#include <QPair>
+#include <QtAlgorithms>
+
+// Define some constants for ease of use when tweaking and debugging
+static const qreal LAYER_SHAPE_LAYER_DISTANCE = 120.0;     // The distance between the layers
+static const qreal LAYER_SHAPE_NODE_DISTANCE = 80.0;       // The least distance between the nodes of a layer
+static const int LAYER_SHAPE_SWEEPS = 12;                  // The number of times all layers are ordered
+static const int LAYER_SHAPE_ALIGN_PASSES = 4;             // The number of times the nodes are moved towards their neighbours
+
+/*
+ *  Constructor
+ */
+LayerShapePositionCalc::LayerShapePositionCalc()
+    : _parity(0)
+{
+}
+
+/*
+ *  Calculates the positions of all nodes, centered around the origin
+ */
+void LayerShapePositionCalc::calculate()
+{
+    layerShape();
+}
+
+/*
+ *  Creates the node map, see the steps in the header. The layers are placed from the top down
+ *  and the nodes of each layer from left to right, centered around the origin.
+ */
+void LayerShapePositionCalc::layerShape()
+{
+    if (_graph->nodeCount() == 0)
+        return;
+
+    collectNeighbours(_neighbourOffsets, _neighbours);
+    breakCycles();
+    assignLayers();
+    reduceCrossings();
+    assignCoordinates();
+
+    const int layers = _layerOffsets.size() - 1;
+
+    for (int row = 0; row < _graph->nodeCount(); ++row) {
+        const qreal y = (_layerOf.at(row) - (layers - 1) / 2.0) * LAYER_SHAPE_LAYER_DISTANCE;
+
+        _graph->setPosition(row, QPoint(qRound(_x.at(row)), qRound(y)));
+    }
+
+    // The buffers are only needed while calculating
+    _neighbourOffsets.clear();
+    _neighbours.clear();
+    _postorder.clear();
+    _layerOf.clear();
+    _layerOffsets.clear();
+    _layerRows.clear();
+    _orderOf.clear();
+    _nextOrderOf.clear();
+    _x.clear();
+
+    calculateCurrentSize();
+}
+
+/*
+ *  Runs a depth-first search along the edges, from the nodes without parents first, and notes
+ *  the order the nodes are finished in. An edge to a node finished earlier points down; the
+ *  only other edges are the ones back to a node still being searched, which close a cycle.
+ *  Those are turned around, so with all edges pointing from a later finished node to an
+ *  earlier one the graph has no cycles.
+ */
+void LayerShapePositionCalc::breakCycles()
+{
+    const int count = _graph->nodeCount();
+    QBitArray visited(count);
+    QVector<int> stackRows;
+    QVector<int> stackNextChild;            // The next edge to follow from each node on the stack
+    int finished = 0;
+
+    _postorder.fill(-1, count);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int root = 0; root < count; ++root) {
+            // Search from the nodes without parents first, then from any left in cycles of their own
+            if (visited.testBit(root) || (pass == 0 && _graph->parentCount(root) > 0))
+                continue;
+
+            visited.setBit(root);
+            stackRows.append(root);
+            stackNextChild.append(_graph->childBegin(root));
+
+            while (!stackRows.isEmpty()) {
+                if (stackNextChild.last() < _graph->childEnd(stackRows.last())) {
+                    const int child = _graph->childRow(stackNextChild.last()++);
+
+                    if (!visited.testBit(child)) {
+                        visited.setBit(child);
+                        stackRows.append(child);
+                        stackNextChild.append(_graph->childBegin(child));
+                    }
+                }
+                else {
+                    _postorder[stackRows.last()] = finished++;
+                    stackRows.removeLast();
+                    stackNextChild.removeLast();
+                }
+            }
+        }
+    }
+}
+
+/*
+ *  Puts each node in the layer below the lowest node it's connected with from above, i.e.
+ *  at the end of the longest path down to it. The nodes are handled from the last finished,
+ *  so all nodes above one are done before it. The nodes of each layer start in that order too,
+ *  which keeps the nodes found from the same one together.
+ */
+void LayerShapePositionCalc::assignLayers()
+{
+    const int count = _graph->nodeCount();
+    QVector<int> byPostorder(count);
+    int layers = 1;
+
+    for (int row = 0; row < count; ++row) {
+        byPostorder[_postorder.at(row)] = row;
+    }
+
+    _layerOf.fill(0, count);
+
+    for (int i = count - 1; i >= 0; --i) {
+        const int row = byPostorder.at(i);
+        const int below = _layerOf.at(row) + 1;
+
+        for (int j = _neighbourOffsets.at(row); j < _neighbourOffsets.at(row + 1); ++j) {
+            const int neighbour = _neighbours.at(j);
+
+            if (_postorder.at(neighbour) < i && _layerOf.at(neighbour) < below)
+                _layerOf[neighbour] = below;
+        }
+
+        layers = qMax(layers, below);
+    }
+
+    // Sort the nodes by layer, in the order they were handled in
+    _layerOffsets.fill(0, layers + 1);
+
+    for (int row = 0; row < count; ++row) {
+        ++_layerOffsets[_layerOf.at(row) + 1];
+    }
+
+    for (int layer = 0; layer < layers; ++layer) {
+        _layerOffsets[layer + 1] += _layerOffsets.at(layer);
+    }
+
+    QVector<int> layerEnds = _layerOffsets;
+
+    _layerRows.resize(count);
+    _orderOf.resize(count);
+
+    for (int i = count - 1; i >= 0; --i) {
+        const int row = byPostorder.at(i);
+        const int layer = _layerOf.at(row);
+
+        _orderOf[row] = layerEnds.at(layer) - _layerOffsets.at(layer);
+        _layerRows[layerEnds[layer]++] = row;
+    }
+}
+
+/*
+ *  Orders the nodes of the layers to cut down on the crossing edges: the even layers are
+ *  ordered by the positions of the nodes in the odd ones, then the other way around, a number
+ *  of times. The layers of the same turn only look at the positions from before the turn, so
+ *  they are ordered in parallel, and the result doesn't depend on the number of threads.
+ *  When canceled, the layers keep the order of the last sweep.
+ */
+void LayerShapePositionCalc::reduceCrossings()
+{
+    // The layers not ordered in a turn keep their order in _nextOrderOf as well
+    _nextOrderOf.resize(_orderOf.size());
+
+    for (int row = 0; row < _orderOf.size(); ++row) {
+        _nextOrderOf[row] = _orderOf.at(row);
+    }
+
+    for (int sweep = 0; sweep < LAYER_SHAPE_SWEEPS && !isCanceled(); ++sweep) {
+        for (_parity = 0; _parity < 2; ++_parity) {
+            orderLayers();
+
+            // Copied, not assigned, so the threads never write to a vector shared with another
+            for (int row = 0; row < _orderOf.size(); ++row) {
+                _orderOf[row] = _nextOrderOf.at(row);
+            }
+        }
+    }
+}
+
+/*
+ *  Orders the layers of the current parity on all threads, a layer per task (see runTasks()).
+ *  Returns when all of them are done.
+ */
+void LayerShapePositionCalc::orderLayers()
+{
+    const int layers = _layerOffsets.size() - 1;
+
+    runTasks((layers + 1 - _parity) / 2);
+}
+
+/*
+ *  Orders the [task]th layer of the current parity
+ */
+void LayerShapePositionCalc::runTask(int task)
+{
+    orderLayer(task * 2 + _parity);
+}
+
+/*
+ *  Sorts the nodes of [layer] by the barycentre of their neighbours, i.e. their mean position.
+ *  The positions are taken relative to the width of the neighbour's layer, so a narrow layer
+ *  pulls as much as a wide one, and a neighbour n layers away counts 1/n^2 as much as one in
+ *  the next layer. A node without neighbours keeps its position; nodes with the same
+ *  barycentre keep their order.
+ */
+void LayerShapePositionCalc::orderLayer(int layer)
+{
+    const int begin = _layerOffsets.at(layer);
+    const int size = layerSize(layer);
+    QVector<QPair<qreal, int> > barycentres(size);
+
+    for (int i = 0; i < size; ++i) {
+        const int row = _layerRows.at(begin + i);
+        qreal sum = 0.0;
+        qreal weights = 0.0;
+
+        for (int j = _neighbourOffsets.at(row); j < _neighbourOffsets.at(row + 1); ++j) {
+            const int neighbour = _neighbours.at(j);
+            const qreal span = qAbs(_layerOf.at(neighbour) - layer);
+            const qreal weight = 1.0 / (span * span);
+
+            sum += weight * (_orderOf.at(neighbour) + 0.5) / layerSize(_layerOf.at(neighbour));
+            weights += weight;
+        }
+
+        const qreal barycentre = weights > 0.0 ? sum / weights : (i + 0.5) / size;
+
+        barycentres[i] = qMakePair(barycentre, i);
+    }
+
+    qSort(barycentres);
+
+    const QVector<int> rows = _layerRows.mid(begin, size);
+
+    for (int i = 0; i < size; ++i) {
+        const int row = rows.at(barycentres.at(i).second);
+
+        _layerRows[begin + i] = row;
+        _nextOrderOf[row] = i;
+    }
+}
+
+/*
+ *  Sets the position of the nodes within their layers: first side by side in their order,
+ *  then moved towards their neighbours in the layers above, and below, a few times over.
+ *  At last the layout is centered around the origin.
+ */
+void LayerShapePositionCalc::assignCoordinates()
+{
+    const int layers = _layerOffsets.size() - 1;
+
+    _x.resize(_graph->nodeCount());
+
+    for (int layer = 0; layer < layers; ++layer) {
+        for (int i = 0; i < layerSize(layer); ++i) {
+            _x[_layerRows.at(_layerOffsets.at(layer) + i)] = (i - (layerSize(layer) - 1) / 2.0) * LAYER_SHAPE_NODE_DISTANCE;
+        }
+    }
+
+    for (int pass = 0; pass < LAYER_SHAPE_ALIGN_PASSES; ++pass) {
+        if (pass % 2 == 0) {
+            for (int layer = 1; layer < layers; ++layer) {
+                alignLayer(layer, true);
+            }
+        }
+        else {
+            for (int layer = layers - 2; layer >= 0; --layer) {
+                alignLayer(layer, false);
+            }
+        }
+    }
+
+    qreal minX = _x.first(), maxX = minX;
+
+    foreach (qreal x, _x) {
+        minX = qMin(minX, x);
+        maxX = qMax(maxX, x);
+    }
+
+    const qreal center = (minX + maxX) / 2.0;
+
+    for (int row = 0; row < _x.size(); ++row) {
+        _x[row] -= center;
+    }
+}
+
+/*
+ *  Moves the nodes of [layer] to the mean position of their neighbours above it, or below
+ *  it if not [towardsAbove], keeping them in order and at least the node distance apart.
+ *  The packing is done from the left, pushing nodes right of where they want to be, and
+ *  from the right; the mean of the two keeps the distance and the nodes close to their spots.
+ */
+void LayerShapePositionCalc::alignLayer(int layer, bool towardsAbove)
+{
+    const int begin = _layerOffsets.at(layer);
+    const int size = layerSize(layer);
+
+    if (size == 0)
+        return;
+
+    QVector<qreal> wanted(size);
+    QVector<qreal> fromLeft(size);
+    QVector<qreal> fromRight(size);
+
+    for (int i = 0; i < size; ++i) {
+        const int row = _layerRows.at(begin + i);
+        qreal sum = 0.0;
+        int neighbours = 0;
+
+        for (int j = _neighbourOffsets.at(row); j < _neighbourOffsets.at(row + 1); ++j) {
+            const int neighbour = _neighbours.at(j);
+
+            if ((_layerOf.at(neighbour) < layer) == towardsAbove) {
+                sum += _x.at(neighbour);
+                ++neighbours;
+            }
+        }
+
+        wanted[i] = neighbours > 0 ? sum / neighbours : _x.at(row);
+    }
+
+    fromLeft[0] = wanted.at(0);
+
+    for (int i = 1; i < size; ++i) {
+        fromLeft[i] = qMax(wanted.at(i), fromLeft.at(i - 1) + LAYER_SHAPE_NODE_DISTANCE);
+    }
+
+    fromRight[size - 1] = wanted.at(size - 1);
+
+    for (int i = size - 2; i >= 0; --i) {
+        fromRight[i] = qMin(wanted.at(i), fromRight.at(i + 1) - LAYER_SHAPE_NODE_DISTANCE);
+    }
+
+    for (int i = 0; i < size; ++i) {
+        _x[_layerRows.at(begin + i)] = (fromLeft.at(i) + fromRight.at(i)) / 2.0;
+    }
+}
@@ -7,11 +7,19 @@
  */
 
 #include "visnode.h"
+#include "benchmark.h"
 #include <QApplication>
+#include <QCoreApplication>
 #include <QStringList>
 
 int main (int argc, char* argv[])
 {
+    // The benchmarks show no window, and take no other arguments
+    if (argc == 2 && qstrcmp(argv[1], "--bench") == 0) {
+        QCoreApplication app(argc, argv);
+        return Benchmark::run();
+    }
+
     QApplication app(argc, argv);
 
     QStringList args;
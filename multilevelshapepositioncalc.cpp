@@ -0,0 +1,248 @@
+#include "multilevelshapepositioncalc.h"
+#include "nodegraph.h"
+#include <qmath.h>
+
+// Define some constants for ease of use when tweaking and debugging
+static const int MULTILEVEL_COARSEST_NODES = 300;          // Stop coarsening at no more nodes than this
+static const qreal MULTILEVEL_MIN_SHRINK = 0.8;            // Stop coarsening when a level keeps more of the nodes than this
+static const qreal MULTILEVEL_DISTANCE_RATIO = 1.3228757;  // The ideal edge length grows by sqrt(7/4) per coarser level
+static const int MULTILEVEL_REFINE_ITERATIONS = 50;        // The most iterations for refining each finer level
+static const qreal MULTILEVEL_SPREAD = 0.1;                // How far from the merged node's position the nodes in it are placed, in edge lengths
+
+/*
+ *  Constructor
+ */
+MultilevelShapePositionCalc::MultilevelShapePositionCalc()
+{
+}
+
+/*
+ *  Calculates the positions of all nodes, centered around the origin
+ */
+void MultilevelShapePositionCalc::calculate()
+{
+    multilevelShape();
+}
+
+/*
+ *  Creates the node map, see the steps in the header. The coarsest graph gets the set number
+ *  of iterations, the finer ones no more than MULTILEVEL_REFINE_ITERATIONS each. The
+ *  convergence threshold grows with the edge length of the coarser levels.
+ */
+void MultilevelShapePositionCalc::multilevelShape()
+{
+    if (_graph->nodeCount() == 0)
+        return;
+
+    const qreal finestDistance = _nodeDistance;
+    QList<GraphLevel> levels;
+
+    collectGraph();
+
+    levels.append(GraphLevel());
+    levels.last().masses = _masses;
+    levels.last().neighbourOffsets = _neighbourOffsets;
+    levels.last().neighbours = _neighbours;
+    levels.last().neighbourWeights = _neighbourWeights;
+
+    while (levels.last().masses.size() > MULTILEVEL_COARSEST_NODES) {
+        GraphLevel coarse;
+
+        if (!coarsen(levels.last(), coarse))
+            break;
+
+        levels.append(coarse);
+    }
+
+    _nodeDistance = finestDistance * qPow(MULTILEVEL_DISTANCE_RATIO, levels.size() - 1);
+
+    useLevel(levels.last());
+    spiralPositions();
+    settle(_nodeDistance * qMax(1.0, qSqrt(_masses.size()) / 4.0), _maxIterations,
+           _convergenceThreshold * _nodeDistance / finestDistance);
+
+    // Going finer, the coarser levels aren't needed any more
+    levels.removeLast();
+
+    while (!levels.isEmpty()) {
+        _nodeDistance /= MULTILEVEL_DISTANCE_RATIO;
+
+        expandFrom(levels.last());
+        useLevel(levels.last());
+        settle(_nodeDistance, qMin(_maxIterations, MULTILEVEL_REFINE_ITERATIONS),
+               _convergenceThreshold * _nodeDistance / finestDistance);
+
+        levels.removeLast();
+    }
+
+    _nodeDistance = finestDistance;
+
+    applyPositions();
+    clearBuffers();
+
+    calculateCurrentSize();
+}
+
+/*
+ *  Merges the nodes of [fine] into the nodes of [coarse], noting which in fine.groupOf:
+ *
+ *  1. Each node not yet merged is paired with its lightest neighbour not yet merged, which
+ *     keeps the masses of the merged nodes even
+ *  2. The nodes left, whose neighbours were all taken, join their lightest neighbouring
+ *     merged node (e.g. the leaves of a star). Nodes without neighbours are paired up.
+ *  3. The edges between the merged nodes are collected, the ones between the same two
+ *     merged into one with the weights added up
+ *
+ *  The nodes are handled in row order, so the same graph always gives the same hierarchy.
+ *  Returns false, leaving [coarse] unfinished, if too few nodes could be merged.
+ */
+bool MultilevelShapePositionCalc::coarsen(GraphLevel& fine, GraphLevel& coarse) const
+{
+    const int count = fine.masses.size();
+    QVector<int>& groupOf = fine.groupOf;
+    int groups = 0;
+    int loneNode = -1;                  // A node without neighbours waiting for another
+
+    groupOf.fill(-1, count);
+    coarse.masses.clear();
+
+    for (int row = 0; row < count; ++row) {
+        if (groupOf.at(row) >= 0)
+            continue;
+
+        int match = -1;
+
+        for (int i = fine.neighbourOffsets.at(row); i < fine.neighbourOffsets.at(row + 1); ++i) {
+            const int neighbour = fine.neighbours.at(i);
+
+            if (groupOf.at(neighbour) < 0 && (match < 0 || fine.masses.at(neighbour) < fine.masses.at(match)))
+                match = neighbour;
+        }
+
+        if (match >= 0) {
+            groupOf[row] = groupOf[match] = groups++;
+            coarse.masses.append(fine.masses.at(row) + fine.masses.at(match));
+        }
+    }
+
+    for (int row = 0; row < count; ++row) {
+        if (groupOf.at(row) >= 0)
+            continue;
+
+        int group = -1;
+
+        for (int i = fine.neighbourOffsets.at(row); i < fine.neighbourOffsets.at(row + 1); ++i) {
+            const int neighbourGroup = groupOf.at(fine.neighbours.at(i));
+
+            if (neighbourGroup >= 0 && (group < 0 || coarse.masses.at(neighbourGroup) < coarse.masses.at(group)))
+                group = neighbourGroup;
+        }
+
+        if (group < 0 && loneNode >= 0) {
+            group = groupOf.at(loneNode);
+            loneNode = -1;
+        }
+
+        if (group >= 0) {
+            groupOf[row] = group;
+            coarse.masses[group] += fine.masses.at(row);
+        }
+        else {
+            groupOf[row] = groups++;
+            coarse.masses.append(fine.masses.at(row));
+            loneNode = row;
+        }
+    }
+
+    if (groups > MULTILEVEL_MIN_SHRINK * count)
+        return false;
+
+    // The nodes of each merged node, one after another
+    QVector<int> memberOffsets(groups + 1, 0);
+    QVector<int> members(count);
+
+    for (int row = 0; row < count; ++row) {
+        ++memberOffsets[groupOf.at(row) + 1];
+    }
+
+    for (int group = 0; group < groups; ++group) {
+        memberOffsets[group + 1] += memberOffsets.at(group);
+    }
+
+    QVector<int> memberEnds = memberOffsets;
+
+    for (int row = 0; row < count; ++row) {
+        members[memberEnds[groupOf.at(row)]++] = row;
+    }
+
+    // An edge to a merged node already seen from this one only adds its weight
+    QVector<int> lastSeenFrom(groups, -1);
+    QVector<int> edgeOf(groups);
+
+    coarse.neighbourOffsets.resize(groups + 1);
+    coarse.neighbours.clear();
+    coarse.neighbourWeights.clear();
+
+    for (int group = 0; group < groups; ++group) {
+        coarse.neighbourOffsets[group] = coarse.neighbours.size();
+
+        for (int i = memberOffsets.at(group); i < memberOffsets.at(group + 1); ++i) {
+            const int row = members.at(i);
+
+            for (int j = fine.neighbourOffsets.at(row); j < fine.neighbourOffsets.at(row + 1); ++j) {
+                const int neighbourGroup = groupOf.at(fine.neighbours.at(j));
+
+                if (neighbourGroup == group)
+                    continue;
+
+                if (lastSeenFrom.at(neighbourGroup) != group) {
+                    lastSeenFrom[neighbourGroup] = group;
+                    edgeOf[neighbourGroup] = coarse.neighbours.size();
+                    coarse.neighbours.append(neighbourGroup);
+                    coarse.neighbourWeights.append(fine.neighbourWeights.at(j));
+                }
+                else {
+                    coarse.neighbourWeights[edgeOf.at(neighbourGroup)] += fine.neighbourWeights.at(j);
+                }
+            }
+        }
+    }
+
+    coarse.neighbourOffsets[groups] = coarse.neighbours.size();
+
+    return true;
+}
+
+/*
+ *  Makes [level] the graph being laid out
+ */
+void MultilevelShapePositionCalc::useLevel(const GraphLevel& level)
+{
+    _masses = level.masses;
+    _neighbourOffsets = level.neighbourOffsets;
+    _neighbours = level.neighbours;
+    _neighbourWeights = level.neighbourWeights;
+}
+
+/*
+ *  Places the nodes of [fine] around the position of the node they were merged into, in the
+ *  graph being laid out, a bit apart so the forces can tell them apart
+ */
+void MultilevelShapePositionCalc::expandFrom(const GraphLevel& fine)
+{
+    const int count = fine.groupOf.size();
+    const qreal spread = MULTILEVEL_SPREAD * _nodeDistance;
+    QVector<float> x(count);
+    QVector<float> y(count);
+
+    for (int row = 0; row < count; ++row) {
+        const int group = fine.groupOf.at(row);
+        const qreal angle = row * GOLDEN_ANGLE;
+
+        x[row] = _x.at(group) + spread * qCos(angle);
+        y[row] = _y.at(group) + spread * qSin(angle);
+    }
+
+    _x.swap(x);
+    _y.swap(y);
+}
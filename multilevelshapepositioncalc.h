@@ -0,0 +1,50 @@
+/*
+ * multilevelshapepositioncalc.h
+ *
+ * This class calculates the position of the nodes to be represented graphically in the view,
+ * with the force-directed layout of ForceShapePositionCalc run on a hierarchy of ever coarser
+ * graphs (in the style of Walshaw's multilevel layout):
+ *
+ *  1. The graph is coarsened level by level, by merging each node with a neighbour, until a
+ *     few hundred nodes are left. A merged node weighs as much as the nodes in it, and edges
+ *     between the same merged nodes are merged into one with their weights added up.
+ *  2. The coarsest graph is laid out from scratch, which is quick with so few nodes.
+ *  3. Level by level, each node is placed where the node it was merged into ended up, and
+ *     the layout is refined with a few iterations. The ideal edge length shrinks a bit for
+ *     every finer level.
+ *
+ * The global shape of the layout is found on the small graphs, so the full graph only needs
+ * a fraction of the iterations of a layout of its own.
+ */
+
+#ifndef MULTILEVELSHAPEPOSITIONCALC_H
+#define MULTILEVELSHAPEPOSITIONCALC_H
+
+#include "forceshapepositioncalc.h"
+#include <QList>
+#include <QVector>
+
+class MultilevelShapePositionCalc : public ForceShapePositionCalc
+{
+public:
+    MultilevelShapePositionCalc();
+
+    virtual void calculate();
+
+private:
+    // A graph of the hierarchy, as in ForceShapePositionCalc
+    struct GraphLevel {
+        QVector<float> masses;
+        QVector<int> neighbourOffsets;
+        QVector<int> neighbours;
+        QVector<float> neighbourWeights;
+        QVector<int> groupOf;           // The node of the next coarser level each node is merged into
+    };
+
+    void multilevelShape();
+    bool coarsen(GraphLevel& fine, GraphLevel& coarse) const;
+    void useLevel(const GraphLevel& level);
+    void expandFrom(const GraphLevel& fine);
+};
+
+#endif // MULTILEVELSHAPEPOSITIONCALC_H
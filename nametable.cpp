@@ -0,0 +1,99 @@
+#include "nametable.h"
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+// The id of a name is its index within its shard, shifted up, with the shard number in the low bits
+static const int SHARD_BITS = 4;
+static const int SHARD_COUNT = 1 << SHARD_BITS;
+
+struct NameShard
+{
+    QReadWriteLock lock;
+    QHash<QString, quint32> ids;
+    QVector<QString> names;
+};
+
+static NameShard shards[SHARD_COUNT];
+
+
+/*
+ *  Returns the shard [name] belongs in
+ */
+static inline quint32 shardOf(const QString& name)
+{
+    return qHash(name) & (SHARD_COUNT - 1);
+}
+
+
+/*
+ *  Returns the id of [name], adding it to the table if it's new. Thread-safe.
+ */
+quint32 NameTable::intern(const QString& name)
+{
+    const quint32 shardIndex = shardOf(name);
+    NameShard& shard = shards[shardIndex];
+
+    {
+        QReadLocker locker(&shard.lock);
+        QHash<QString, quint32>::const_iterator found = shard.ids.constFind(name);
+
+        if (found != shard.ids.constEnd())
+            return found.value();
+    }
+
+    QWriteLocker locker(&shard.lock);
+
+    // Another thread may have added it while the lock was released
+    QHash<QString, quint32>::const_iterator found = shard.ids.constFind(name);
+
+    if (found != shard.ids.constEnd())
+        return found.value();
+
+    const quint32 id = (static_cast<quint32>(shard.names.size()) << SHARD_BITS) | shardIndex;
+    shard.names.append(name);
+    shard.ids.insert(name, id);
+
+    return id;
+}
+
+
+/*
+ *  Returns the id of [name], or NO_ID if it isn't in the table. Thread-safe.
+ */
+quint32 NameTable::find(const QString& name)
+{
+    NameShard& shard = shards[shardOf(name)];
+    QReadLocker locker(&shard.lock);
+
+    return shard.ids.value(name, NO_ID);
+}
+
+
+/*
+ *  Returns the name with the id, which must be one given by intern(). Thread-safe.
+ *  The string is shared with the table, no characters are copied.
+ */
+QString NameTable::name(quint32 id)
+{
+    NameShard& shard = shards[id & (SHARD_COUNT - 1)];
+    QReadLocker locker(&shard.lock);
+
+    return shard.names.at(id >> SHARD_BITS);
+}
+
+
+/*
+ *  Returns the number of names in the table
+ */
+int NameTable::size()
+{
+    int size = 0;
+
+    for (int i = 0; i < SHARD_COUNT; ++i) {
+        QReadLocker locker(&shards[i].lock);
+        size += shards[i].names.size();
+    }
+
+    return size;
+}
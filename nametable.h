@@ -0,0 +1,31 @@
+/*
+ * nametable.h
+ *
+ * NameTable is the program wide table of interned names: each distinct name (node names,
+ * labels) is stored once and referred to by a 32-bit id. Nodes and edges keep ids only,
+ * so comparing names is comparing integers. Ids are never reused while the program runs.
+ *
+ * The table is split into shards with a lock each, picked by the name's hash, so the
+ * parsers on the worker threads rarely wait for each other when interning.
+ */
+
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+#include <QString>
+
+class NameTable
+{
+public:
+    static const quint32 NO_ID = 0xffffffff;       // The id of a name that isn't in the table
+
+    static quint32 intern(const QString& name);
+    static quint32 find(const QString& name);
+    static QString name(quint32 id);
+    static int size();
+
+private:
+    NameTable();
+};
+
+#endif // NAMETABLE_H
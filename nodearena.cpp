@@ -0,0 +1,77 @@
+#include "nodearena.h"
+#include "nodeitem.h"
+#include <new>                  // placement new
+
+static const int BLOCK_NODES = 4096;        // The number of nodes in each block
+
+
+/*
+ *  Returns the address of slot [index] in [block]
+ */
+static inline NodeItem* slot(char* block, int index)
+{
+    return reinterpret_cast<NodeItem*>(block + index * sizeof(NodeItem));
+}
+
+
+/*
+ *  Constructor
+ */
+NodeArena::NodeArena()
+    : _blockUsed(BLOCK_NODES)
+{
+}
+
+
+/*
+ *  Destructor, destroys all nodes still in the arena
+ */
+NodeArena::~NodeArena()
+{
+    clear();
+}
+
+
+/*
+ *  Creates a node in the arena, after the last node
+ */
+NodeItem* NodeArena::create(int index, quint32 nameId, const QColor& color)
+{
+    if (_blockUsed == BLOCK_NODES) {
+        _blocks.append(static_cast<char*>(::operator new(BLOCK_NODES * sizeof(NodeItem))));
+        _blockUsed = 0;
+    }
+
+    return new (slot(_blocks.last(), _blockUsed++)) NodeItem(index, nameId, color);
+}
+
+
+/*
+ *  Destroys all nodes and frees the memory blocks
+ */
+void NodeArena::clear()
+{
+    for (int i = 0; i < _blocks.size(); ++i) {
+        const int used = i == _blocks.size() - 1 ? _blockUsed : BLOCK_NODES;
+
+        for (int j = 0; j < used; ++j)
+            slot(_blocks.at(i), j)->~NodeItem();
+
+        ::operator delete(_blocks.at(i));
+    }
+
+    _blocks.clear();
+    _blockUsed = BLOCK_NODES;
+}
+
+
+/*
+ *  Returns the number of nodes in the arena
+ */
+int NodeArena::size() const
+{
+    if (_blocks.isEmpty())
+        return 0;
+
+    return (_blocks.size() - 1) * BLOCK_NODES + _blockUsed;
+}
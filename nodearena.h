@@ -0,0 +1,35 @@
+/*
+ * nodearena.h
+ *
+ * NodeArena allocates nodes from large blocks of memory, one after another, instead of one
+ * heap allocation per node. All nodes are destroyed and the blocks freed at once when the
+ * arena is cleared or destroyed. Not thread-safe, see NodeCreator::addNode().
+ */
+
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <QColor>
+#include <QList>
+
+class NodeItem;
+
+class NodeArena
+{
+public:
+    NodeArena();
+    ~NodeArena();
+
+    NodeItem* create(int index, quint32 nameId, const QColor& color = QColor());
+    void clear();
+
+    int size() const;
+
+private:
+    Q_DISABLE_COPY(NodeArena)
+
+    QList<char*> _blocks;
+    int _blockUsed;                     // The number of nodes in the last block
+};
+
+#endif // NODEARENA_H
@@ -3,8 +3,8 @@
 /*
  *  Constructor
  */
-NodeCreator::NodeCreator(QList<NodeItem*>& nodelist, QObject* nodeObjectParent)
-    : _nodelist(nodelist), _nodeObjectParent(nodeObjectParent)
+NodeCreator::NodeCreator(QList<NodeItem*>& nodelist, NodeIndex& nodeIndex, NodeArena& nodeArena)
+    : _nodelist(nodelist), _nodeIndex(nodeIndex), _nodeArena(nodeArena)
 {
 }
 
@@ -13,9 +13,17 @@ NodeCreator::NodeCreator(QList<NodeItem*>& nodelist, QObject* nodeObjectParent)
  *  Checks and does:
  *      The parent node exists (parentName)             - if not: creates it
  *      The current node exists (nodeName)              - if not: creates it
- *      The parent node has the current node as child   - if not: adds it
+ *      The parent node has the current node as child   - if not: adds it, otherwise counts the repeated edge
  */
 void NodeCreator::createNode(const QString& nodeName, const QString& parentName, const QColor& color, const QColor &parentColor)
+{
+    createNode(NameTable::intern(nodeName), NameTable::intern(parentName), color, parentColor);
+}
+
+/*
+ *  The same as above, for names already interned
+ */
+void NodeCreator::createNode(quint32 nodeId, quint32 parentId, const QColor& color, const QColor &parentColor)
 {
     NodeItem* currentNode;
     NodeItem* parentNode;
@@ -25,19 +33,17 @@ void NodeCreator::createNode(const QString& nodeName, const QString& parentName,
     }
 
     // If the parent node doesn't exist, create it. Otherwise, have it returned.
-    if ((parentNode = getNode(parentName)) == NULL) {
-        parentNode = addNode(nodeName, parentColor);
+    if ((parentNode = getNode(parentId)) == NULL) {
+        parentNode = addNode(parentId, parentColor);
     }
 
     // If the current node doesn't exist, create it. Otherwise, have it returned.
-    if ((currentNode = getNode(nodeName)) == NULL) {
-        currentNode = addNode(nodeName, color);
+    if ((currentNode = getNode(nodeId)) == NULL) {
+        currentNode = addNode(nodeId, color);
     }
 
-    // If the parent node doesn't have the current node as a child, add it.
-    if (!parentNode->hasChild(nodeName)) {
-        parentNode->addChild(currentNode);
-    }
+    // Add the current node as a child, if the parent already has it the edge is only counted again
+    parentNode->addChild(currentNode);
 }
 
 /*
@@ -45,47 +51,77 @@ void NodeCreator::createNode(const QString& nodeName, const QString& parentName,
  */
 void NodeCreator::createStandAloneNode(const QString &nodeName, const QColor &color)
 {
-    NodeItem* currentNode;
+    createStandAloneNode(NameTable::intern(nodeName), color);
+}
 
-    // If the current node doesn't exist, create it. Otherwise, have it returned.
-    if ((currentNode = getNode(nodeName)) == NULL) {
-        currentNode = addNode(nodeName, color);
+/*
+ *  The same as above, for a name already interned
+ */
+void NodeCreator::createStandAloneNode(quint32 nodeId, const QColor &color)
+{
+    // If the current node doesn't exist, create it
+    if (getNode(nodeId) == NULL) {
+        addNode(nodeId, color);
     }
 }
 
 /*
- *  Utility function that adds a node to the node list
+ *  Merges nodes created into another node list (e.g. by a parser on a worker thread)
+ *  into this node list. Nodes are added in the order of [nodes] and each node's children
+ *  keep their order, so merging the lists of several files one by one gives the same
+ *  result as if the files had been parsed straight into this node list.
+ *  Thread-safe with regards to other merges.
  */
-NodeItem* NodeCreator::addNode(const QString& name, const QColor& color)
+void NodeCreator::mergeNodes(const QList<NodeItem*>& nodes)
 {
-    NodeItem* newNode = new NodeItem(_nodelist.size(), name, color, _nodeObjectParent);
-    _nodelist.append(newNode);
+    QMutexLocker locker(&_mergeMutex);
 
-    return newNode;
-}
+    // Make sure all nodes exist first, as a child may be found before its parent in the list
+    foreach (NodeItem* node, nodes) {
+        if (getNode(node->nameId()) == NULL)
+            addNode(node->nameId(), node->color());
+    }
+
+    // Then add the edges, those already known only have their multiplicities added up
+    foreach (NodeItem* node, nodes) {
+        NodeItem* parentNode = getNode(node->nameId());
 
+        foreach (NodeItem* child, node->children())
+            parentNode->addChild(getNode(child->nameId()), node->childMultiplicity(child));
+    }
+}
 
 /*
- *  Utility function that sets the parent QObject for all the nodes.
- *  Setting a parent ensures they are deleted with the parent.
+ *  Utility function that adds a node to the node list, allocated from the node arena which owns
+ *  it. Only one thread at a time may create nodes in an arena, the worker parsers have arenas
+ *  of their own and mergeNodes() sees to the shared one.
  */
-void NodeCreator::setNodeObjectParent(QObject* parent)
+NodeItem* NodeCreator::addNode(quint32 nameId, const QColor& color)
 {
-    _nodeObjectParent = parent;
+    NodeItem* newNode = _nodeArena.create(_nodelist.size(), nameId, color);
+
+    _nodelist.append(newNode);
+    _nodeIndex.insert(newNode);
+
+    return newNode;
 }
 
 
 /*
- *  Returns the node with the supplied name.
+ *  Returns the node with the supplied name, looked up in the node index.
  *  If if doesn't exist, NULL is returned.
  */
 NodeItem* NodeCreator::getNode(const QString &nodeName) const
 {
-    for (int i = 0; i < _nodelist.size(); ++i) {
-        if (_nodelist[i]->name() == nodeName)
-            return _nodelist[i];
-    }
-    return NULL;
+    return _nodeIndex.node(nodeName);
+}
+
+/*
+ *  Returns the node with the supplied name id, or NULL if it doesn't exist
+ */
+NodeItem* NodeCreator::getNode(quint32 nodeId) const
+{
+    return _nodeIndex.node(nodeId);
 }
 
 /* Some doodling...
@@ -10,27 +10,57 @@
 #define NODECREATOR_H
 
 #include "nodeitem.h"
-#include <QObject>
+#include "nodeindex.h"
+#include "nodearena.h"
 #include <QList>
 #include <QColor>
+#include <QMutex>
+#include <QPair>
+#include <QStringList>
+
+// The differences in nodes and edges (by name id, see NameTable) after a file has been parsed again,
+// see AbstractNodeParser::reparseFile(). A removed node has no edges left when the changes are applied.
+// The added and changed edges come with their multiplicity, the times all files give them.
+struct NodeChanges
+{
+    typedef QPair<quint32, quint32> Edge;       // The parent's and the child's name id
+
+    bool isEmpty() const
+    {
+        return addedNodes.isEmpty() && removedNodes.isEmpty() && addedEdges.isEmpty() &&
+               changedEdges.isEmpty() && removedEdges.isEmpty();
+    }
+
+    QList<QPair<quint32, QColor> > addedNodes;
+    QList<quint32> removedNodes;
+    QList<QPair<Edge, int> > addedEdges;
+    QList<QPair<Edge, int> > changedEdges;      // Still given, but a different number of times
+    QList<Edge> removedEdges;
+};
 
 
 class NodeCreator
 {
 public:
-    NodeCreator(QList<NodeItem*>& nodelist, QObject* nodeObjectParent = 0);
+    NodeCreator(QList<NodeItem*>& nodelist, NodeIndex& nodeIndex, NodeArena& nodeArena);
 
     void createNode(const QString& nodeName, const QString& parentName,
                     const QColor& color = QColor(), const QColor &parentColor = QColor());
+    void createNode(quint32 nodeId, quint32 parentId,
+                    const QColor& color = QColor(), const QColor &parentColor = QColor());
     void createStandAloneNode(const QString& nodeName, const QColor& color = QColor());
-    void setNodeObjectParent(QObject* parent);
+    void createStandAloneNode(quint32 nodeId, const QColor& color = QColor());
+    void mergeNodes(const QList<NodeItem*>& nodes);
     NodeItem* getNode(const QString& nodeName) const;
+    NodeItem* getNode(quint32 nodeId) const;
 
 private:
     QList<NodeItem*>& _nodelist;
-    QObject* _nodeObjectParent;
+    NodeIndex& _nodeIndex;
+    NodeArena& _nodeArena;
+    QMutex _mergeMutex;
 
-    NodeItem* addNode(const QString &name, const QColor &color);
+    NodeItem* addNode(quint32 nameId, const QColor &color);
 };
 
 #endif // NODECREATOR_H
@@ -0,0 +1,361 @@
+#include "nodegraph.h"
+#include "nodeitem.h"
+#include "nametable.h"
+
+static const int MIN_SLICE_CAPACITY = 4;        // The least room a growing slice is given
+
+/*
+ *  Constructor, the graph is empty until built
+ */
+NodeGraph::NodeGraph()
+    : _unusedChildEdges(0), _unusedParentEdges(0), _edgeCount(0)
+{
+}
+
+
+/*
+ *  Builds the graph from the node list, replacing what it held before.
+ *  A node's row in the graph is its row in the list, and its children are kept in the
+ *  same order as in the node. Done in one pass over the nodes and edges, after counting the
+ *  parents of each node, with the arrays sized up front and no room to spare.
+ */
+void NodeGraph::build(const QList<NodeItem*>& nodes)
+{
+    const int count = nodes.size();
+    int edges = 0;
+
+    foreach (NodeItem* node, nodes)
+        edges += node->childCount();
+
+    _nameIds.resize(count);
+    _names.resize(count);
+    _labels.resize(count);
+    _positions.fill(QPoint(), count);
+    _colors.resize(count);
+    _pinned.fill(false, count);
+    _rows.clear();
+    _childSlices.fill(Slice(), count);
+    _childRows.resize(edges);
+    _multiplicities.resize(edges);
+    _parentSlices.fill(Slice(), count);
+    _parentRows.resize(edges);
+
+    // The parents of each node decide where the slices of parent rows start
+    foreach (NodeItem* node, nodes) {
+        foreach (NodeItem* child, node->children())
+            ++_parentSlices[child->row()].capacity;
+    }
+
+    int parentEdge = 0;
+
+    for (int row = 0; row < count; ++row) {
+        _parentSlices[row].begin = parentEdge;
+        parentEdge += _parentSlices.at(row).capacity;
+    }
+
+    int edge = 0;
+
+    for (int row = 0; row < count; ++row) {
+        NodeItem* node = nodes.at(row);
+        Slice& children = _childSlices[row];
+
+        _nameIds[row] = node->nameId();
+        _names[row] = NameTable::name(node->nameId());
+        _labels[row] = NameTable::name(node->labelId());
+        _colors[row] = node->color().isValid() ? node->color().rgba() : 0;
+        setRowOf(node->nameId(), row);
+        children.begin = edge;
+
+        foreach (NodeItem* child, node->children()) {
+            Slice& parents = _parentSlices[child->row()];
+
+            _childRows[edge] = child->row();
+            _multiplicities[edge] = node->childMultiplicity(child);
+            _parentRows[parents.begin + parents.size++] = row;
+            ++edge;
+        }
+
+        children.size = children.capacity = edge - children.begin;
+    }
+
+    _unusedChildEdges = 0;
+    _unusedParentEdges = 0;
+    _edgeCount = edges;
+}
+
+
+/*
+ *  Returns the row of the node with the name id, or -1 if there's none
+ */
+int NodeGraph::row(quint32 nameId) const
+{
+    return nameId < static_cast<quint32>(_rows.size()) ? _rows.at(nameId) : -1;
+}
+
+
+/*
+ *  Adds a node without edges after the last one, and returns its row.
+ *  The node mustn't be in the graph already.
+ */
+int NodeGraph::addNode(quint32 nameId, const QColor& color)
+{
+    const int row = nodeCount();
+
+    _nameIds.append(nameId);
+    _names.append(NameTable::name(nameId));
+    _labels.append(NameTable::name(NameTable::intern(_names.last().section('/', -1))));
+    _positions.append(QPoint());
+    _colors.append(color.isValid() ? color.rgba() : 0);
+    _pinned.resize(row + 1);
+    _childSlices.append(Slice());
+    _parentSlices.append(Slice());
+    setRowOf(nameId, row);
+
+    return row;
+}
+
+
+/*
+ *  Removes the node in [row] with any edges it still has. The last node takes its row, and
+ *  the nodes connected with that one are told so. Returns the row the last node had, or -1
+ *  if the removed node was the last one.
+ */
+int NodeGraph::removeNode(int row)
+{
+    while (childCount(row) > 0)
+        removeEdge(row, childRow(childEnd(row) - 1));
+
+    while (parentCount(row) > 0)
+        removeEdge(parentRow(parentEnd(row) - 1), row);
+
+    _unusedChildEdges += _childSlices.at(row).capacity;
+    _unusedParentEdges += _parentSlices.at(row).capacity;
+    setRowOf(_nameIds.at(row), -1);
+
+    const int last = nodeCount() - 1;
+
+    if (row != last) {
+        _nameIds[row] = _nameIds.at(last);
+        _names[row] = _names.at(last);
+        _labels[row] = _labels.at(last);
+        _positions[row] = _positions.at(last);
+        _colors[row] = _colors.at(last);
+        _pinned.setBit(row, _pinned.testBit(last));
+        _childSlices[row] = _childSlices.at(last);
+        _parentSlices[row] = _parentSlices.at(last);
+        setRowOf(_nameIds.at(row), row);
+
+        // A node including itself has the row in its own slices as well
+        replaceEdges(_childSlices, _childRows, row, last, row);
+        replaceEdges(_parentSlices, _parentRows, row, last, row);
+
+        for (int edge = childBegin(row); edge < childEnd(row); ++edge)
+            replaceEdges(_parentSlices, _parentRows, _childRows.at(edge), last, row);
+
+        for (int edge = parentBegin(row); edge < parentEnd(row); ++edge)
+            replaceEdges(_childSlices, _childRows, _parentRows.at(edge), last, row);
+    }
+
+    _nameIds.resize(last);
+    _names.resize(last);
+    _labels.resize(last);
+    _positions.resize(last);
+    _colors.resize(last);
+    _pinned.resize(last);
+    _childSlices.resize(last);
+    _parentSlices.resize(last);
+
+    compact(_childSlices, _childRows, &_multiplicities, _unusedChildEdges);
+    compact(_parentSlices, _parentRows, NULL, _unusedParentEdges);
+
+    return row != last ? last : -1;
+}
+
+
+/*
+ *  Adds the edge from [parentRow] to [childRow] with [multiplicity], after the parent's other
+ *  edges. If the edge is there already, only its multiplicity is set.
+ */
+void NodeGraph::setEdge(int parentRow, int childRow, int multiplicity)
+{
+    int edge = findEdge(_childSlices, _childRows, parentRow, childRow);
+
+    if (edge < 0) {
+        edge = appendEdge(_childSlices, _childRows, &_multiplicities, _unusedChildEdges, parentRow);
+        _childRows[edge] = childRow;
+
+        const int reversed = appendEdge(_parentSlices, _parentRows, NULL, _unusedParentEdges, childRow);
+        _parentRows[reversed] = parentRow;
+
+        ++_edgeCount;
+    }
+
+    _multiplicities[edge] = multiplicity;
+}
+
+
+/*
+ *  Removes the edge from [parentRow] to [childRow], if there is one
+ */
+void NodeGraph::removeEdge(int parentRow, int childRow)
+{
+    const int edge = findEdge(_childSlices, _childRows, parentRow, childRow);
+
+    if (edge < 0)
+        return;
+
+    takeEdge(_childSlices, _childRows, &_multiplicities, parentRow, edge);
+    takeEdge(_parentSlices, _parentRows, NULL, childRow, findEdge(_parentSlices, _parentRows, childRow, parentRow));
+
+    --_edgeCount;
+}
+
+
+/*
+ *  Returns the color of the node, invalid if it has none
+ */
+QColor NodeGraph::color(int row) const
+{
+    const QRgb rgba = _colors.at(row);
+
+    return rgba != 0 ? QColor::fromRgba(rgba) : QColor();
+}
+
+
+/*
+ *  Sets the row of the node with the name id in the lookup by name id, growing it as needed
+ */
+void NodeGraph::setRowOf(quint32 nameId, int row)
+{
+    const int size = _rows.size();
+
+    if (nameId >= static_cast<quint32>(size)) {
+        _rows.resize(nameId + 1);
+
+        for (int i = size; i < _rows.size(); ++i)
+            _rows[i] = -1;
+    }
+
+    _rows[nameId] = row;
+}
+
+
+/*
+ *  Returns the index in [rows] of [target] in the slice of [row], or -1 if it isn't there
+ */
+int NodeGraph::findEdge(const QVector<Slice>& slices, const QVector<int>& rows, int row, int target) const
+{
+    const Slice& slice = slices.at(row);
+
+    for (int edge = slice.begin; edge < slice.begin + slice.size; ++edge) {
+        if (rows.at(edge) == target)
+            return edge;
+    }
+
+    return -1;
+}
+
+
+/*
+ *  Makes room for one more edge at the end of the slice of [row], and returns its index.
+ *  A full slice is moved to the end of [rows] (and [multiplicities]) with twice the room,
+ *  which leaves its old place unused.
+ */
+int NodeGraph::appendEdge(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int& unused, int row)
+{
+    if (slices.at(row).size == slices.at(row).capacity) {
+        Slice& slice = slices[row];
+        const int begin = rows.size();
+
+        rows.resize(begin + qMax(2 * slice.capacity, MIN_SLICE_CAPACITY));
+
+        for (int i = 0; i < slice.size; ++i)
+            rows[begin + i] = rows.at(slice.begin + i);
+
+        if (multiplicities != NULL) {
+            multiplicities->resize(rows.size());
+
+            for (int i = 0; i < slice.size; ++i)
+                (*multiplicities)[begin + i] = multiplicities->at(slice.begin + i);
+        }
+
+        unused += slice.capacity;
+        slice.begin = begin;
+        slice.capacity = rows.size() - begin;
+
+        compact(slices, rows, multiplicities, unused);
+    }
+
+    Slice& slice = slices[row];
+
+    return slice.begin + slice.size++;
+}
+
+
+/*
+ *  Removes the edge at [edge] from the slice of [row], keeping the order of the others
+ */
+void NodeGraph::takeEdge(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int row, int edge)
+{
+    Slice& slice = slices[row];
+    const int end = slice.begin + slice.size;
+
+    for (int i = edge + 1; i < end; ++i) {
+        rows[i - 1] = rows.at(i);
+
+        if (multiplicities != NULL)
+            (*multiplicities)[i - 1] = multiplicities->at(i);
+    }
+
+    --slice.size;
+}
+
+
+/*
+ *  Replaces [from] with [to] in the slice of [row]
+ */
+void NodeGraph::replaceEdges(const QVector<Slice>& slices, QVector<int>& rows, int row, int from, int to)
+{
+    const Slice& slice = slices.at(row);
+
+    for (int edge = slice.begin; edge < slice.begin + slice.size; ++edge) {
+        if (rows.at(edge) == from)
+            rows[edge] = to;
+    }
+}
+
+
+/*
+ *  Packs the slices in [rows] (and [multiplicities]) one after another in row order, keeping
+ *  their room to spare, if more than half of the array is left unused
+ */
+void NodeGraph::compact(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int& unused)
+{
+    if (unused <= rows.size() / 2)
+        return;
+
+    QVector<int> packedRows(rows.size() - unused);
+    QVector<int> packedMultiplicities(multiplicities != NULL ? packedRows.size() : 0);
+    int begin = 0;
+
+    for (int row = 0; row < slices.size(); ++row) {
+        Slice& slice = slices[row];
+
+        for (int i = 0; i < slice.size; ++i) {
+            packedRows[begin + i] = rows.at(slice.begin + i);
+
+            if (multiplicities != NULL)
+                packedMultiplicities[begin + i] = multiplicities->at(slice.begin + i);
+        }
+
+        slice.begin = begin;
+        begin += slice.capacity;
+    }
+
+    rows.swap(packedRows);
+
+    if (multiplicities != NULL)
+        multiplicities->swap(packedMultiplicities);
+
+    unused = 0;
+}
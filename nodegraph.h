@@ -0,0 +1,110 @@
+/*
+ * nodegraph.h
+ *
+ * NodeGraph holds the nodes once parsing is done, for the model, the position calculators and
+ * the view to read and change: the name ids, names, labels, positions and colors of the nodes are
+ * kept in arrays of their own, indexed by row, and the edges in compressed sparse row (CSR) form,
+ * i.e. the child rows of all nodes in one array, each node's in a slice of its own.
+ * The edges are kept in reverse as well, the parent rows of each node, so all neighbours of
+ * a node are found in time proportional to its number of edges.
+ *
+ * It's built in one pass from the node list the parsers created, which isn't needed after that.
+ * Later changes (see NodeItemModel::applyChanges()) are patched in place, in time proportional
+ * to the edges of the nodes changed: a slice growing out of its space moves to the end of the
+ * array with room to spare, and the array is packed again when the space left behind outgrows
+ * the edges in use. A removed node's row is taken by the last node.
+ *
+ * The names and labels are the strings of NameTable, taken when a node is added, so the view
+ * reads them without locking the table.
+ */
+
+#ifndef NODEGRAPH_H
+#define NODEGRAPH_H
+
+#include <QBitArray>
+#include <QColor>
+#include <QList>
+#include <QPoint>
+#include <QString>
+#include <QVector>
+
+class NodeItem;
+
+class NodeGraph
+{
+public:
+    NodeGraph();
+
+    void build(const QList<NodeItem*>& nodes);
+
+    int nodeCount() const { return _nameIds.size(); }
+    int edgeCount() const { return _edgeCount; }
+
+    int row(quint32 nameId) const;
+    int addNode(quint32 nameId, const QColor& color = QColor());
+    int removeNode(int row);
+    void setEdge(int parentRow, int childRow, int multiplicity);
+    void removeEdge(int parentRow, int childRow);
+
+    quint32 nameId(int row) const { return _nameIds.at(row); }
+    const QString& name(int row) const { return _names.at(row); }
+    const QString& label(int row) const { return _labels.at(row); }
+    QColor color(int row) const;
+
+    QPoint position(int row) const { return _positions.at(row); }
+    void setPosition(int row, const QPoint& position) { _positions[row] = position; }
+    bool isPinned(int row) const { return _pinned.testBit(row); }
+    void setPinned(int row, bool pinned) { _pinned.setBit(row, pinned); }
+
+    // The edges of a node are [childBegin(row), childEnd(row)), see childRow().
+    // The edge indexes are only valid until the edges are changed.
+    int childBegin(int row) const { return _childSlices.at(row).begin; }
+    int childEnd(int row) const { return _childSlices.at(row).begin + _childSlices.at(row).size; }
+    int childCount(int row) const { return _childSlices.at(row).size; }
+    int childRow(int edge) const { return _childRows.at(edge); }
+    int multiplicity(int edge) const { return _multiplicities.at(edge); }
+
+    // The reversed edges of a node are [parentBegin(row), parentEnd(row)), see parentRow()
+    int parentBegin(int row) const { return _parentSlices.at(row).begin; }
+    int parentEnd(int row) const { return _parentSlices.at(row).begin + _parentSlices.at(row).size; }
+    int parentCount(int row) const { return _parentSlices.at(row).size; }
+    int parentRow(int edge) const { return _parentRows.at(edge); }
+
+private:
+    // A node's part of an edge array
+    struct Slice {
+        Slice() : begin(0), size(0), capacity(0) {}
+        int begin;
+        int size;
+        int capacity;
+    };
+
+    void setRowOf(quint32 nameId, int row);
+    int findEdge(const QVector<Slice>& slices, const QVector<int>& rows, int row, int target) const;
+    int appendEdge(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int& unused, int row);
+    void takeEdge(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int row, int edge);
+    void replaceEdges(const QVector<Slice>& slices, QVector<int>& rows, int row, int from, int to);
+    void compact(QVector<Slice>& slices, QVector<int>& rows, QVector<int>* multiplicities, int& unused);
+
+    QVector<quint32> _nameIds;
+    QVector<QString> _names;
+    QVector<QString> _labels;
+    QVector<QPoint> _positions;
+    QVector<QRgb> _colors;              // 0 for no color, QColor would take four times the space
+    QBitArray _pinned;                  // Placed by the user, the incremental layout doesn't move them
+    QVector<int> _rows;                 // The row of each node by name id, -1 for none. The ids are
+                                        // nearly dense (see NameTable), so this is smaller than a hash.
+
+    QVector<Slice> _childSlices;
+    QVector<int> _childRows;
+    QVector<int> _multiplicities;       // The times each edge was found, see NodeItem::childMultiplicity()
+    int _unusedChildEdges;              // Left behind by the slices moved or removed
+
+    QVector<Slice> _parentSlices;       // As above, for the reversed edges
+    QVector<int> _parentRows;
+    int _unusedParentEdges;
+
+    int _edgeCount;
+};
+
+#endif // NODEGRAPH_H
@@ -0,0 +1,70 @@
+#include "nodeindex.h"
+#include "nodeitem.h"
+
+/*
+ *  Constructor
+ */
+NodeIndex::NodeIndex()
+{
+}
+
+
+/*
+ *  Adds the node to the index, by its name
+ */
+void NodeIndex::insert(NodeItem* node)
+{
+    _nodes.insert(node->nameId(), node);
+}
+
+
+/*
+ *  Removes the node with the supplied name id from the index
+ */
+void NodeIndex::remove(quint32 nameId)
+{
+    _nodes.remove(nameId);
+}
+
+
+/*
+ *  Removes all nodes from the index
+ */
+void NodeIndex::clear()
+{
+    _nodes.clear();
+}
+
+
+/*
+ *  Returns the node with the supplied name id.
+ *  If it isn't in the index, NULL is returned.
+ */
+NodeItem* NodeIndex::node(quint32 nameId) const
+{
+    return _nodes.value(nameId, NULL);
+}
+
+
+/*
+ *  Returns the node with the supplied name.
+ *  If it isn't in the index, NULL is returned.
+ */
+NodeItem* NodeIndex::node(const QString& name) const
+{
+    const quint32 nameId = NameTable::find(name);
+
+    if (nameId == NameTable::NO_ID)
+        return NULL;
+
+    return node(nameId);
+}
+
+
+/*
+ *  Returns the number of nodes in the index
+ */
+int NodeIndex::size() const
+{
+    return _nodes.size();
+}
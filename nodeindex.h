@@ -0,0 +1,34 @@
+/*
+ * nodeindex.h
+ *
+ * NodeIndex is a hash index from node names to the nodes of a node list, kept alongside the list
+ * by the NodeCreator while parsing. It makes finding a node by its name a constant time lookup,
+ * for the parsers. The nodes are indexed by the ids of their interned names.
+ */
+
+#ifndef NODEINDEX_H
+#define NODEINDEX_H
+
+#include "nametable.h"
+#include <QHash>
+#include <QString>
+
+class NodeItem;
+
+class NodeIndex
+{
+public:
+    NodeIndex();
+
+    void insert(NodeItem* node);
+    void remove(quint32 nameId);
+    void clear();
+    NodeItem* node(quint32 nameId) const;
+    NodeItem* node(const QString& name) const;
+    int size() const;
+
+private:
+    QHash<quint32, NodeItem*> _nodes;
+};
+
+#endif // NODEINDEX_H
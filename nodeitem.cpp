@@ -4,20 +4,19 @@
 /*
  *  Constructor
  */
-NodeItem::NodeItem(int index, const QString& name, const QColor& color, QObject* parent)
-    : QObject(parent), _row(index), _name(name), _color(color)
+NodeItem::NodeItem(int index, const QString& name, const QColor& color)
+    : _row(index), _nameId(NameTable::intern(name)),
+      _labelId(NameTable::intern(name.section('/', -1))), _color(color)
 {
 }
 
-NodeItem::NodeItem(const NodeItem &other)
-    : QObject(0)
+/*
+ *  Constructor, for a name already interned
+ */
+NodeItem::NodeItem(int index, quint32 nameId, const QColor& color)
+    : _row(index), _nameId(nameId),
+      _labelId(NameTable::intern(NameTable::name(nameId).section('/', -1))), _color(color)
 {
-    _row = other._row;
-    _name = other._name;
-    _position = other._position;
-    _data = other._data;
-    _children = other._children;
-    _color = other._color;
 }
 
 /*
@@ -34,7 +33,35 @@ NodeItem::~NodeItem()
  */
 QString NodeItem::name() const
 {
-    return _name;
+    return NameTable::name(_nameId);
+}
+
+
+/*
+ *  Returns the id of the node's interned name, which identifies the node
+ */
+quint32 NodeItem::nameId() const
+{
+    return _nameId;
+}
+
+
+/*
+ *  Returns the text to show for the node. For nodes named by a path (e.g. included files),
+ *  that's the last part of the path, otherwise the same as the name.
+ */
+QString NodeItem::label() const
+{
+    return NameTable::name(_labelId);
+}
+
+
+/*
+ *  Returns the id of the node's interned label
+ */
+quint32 NodeItem::labelId() const
+{
+    return _labelId;
 }
 
 
@@ -48,15 +75,15 @@ QVariant NodeItem::data(int role) const
         case (NameRole):
             return name();
 
-        case (PositionRole):
-            return position();
-
         case (NumChildrenRole):
             return childCount();
 
         case (ColorRole):
             return color();
 
+        case (LabelRole):
+            return label();
+
         default:
             return QVariant();
     }
@@ -68,28 +95,19 @@ QVariant NodeItem::data(int role) const
  */
 NodeItem* NodeItem::child(int row) const
 {
-    return dynamic_cast<NodeItem*>(_children.value(row));
+    return _children.value(row);
 }
 
 
 /*
  *  Returns the list of children to the node
  */
-QList<NodeItem*> &NodeItem::children()
+const QList<NodeItem*>& NodeItem::children() const
 {
     return _children;
 }
 
 
-/*
- *  Returns the position of the node
- */
-QPoint NodeItem::position() const
-{
-    return _position;
-}
-
-
 /*
  *  Returns the number of children
  */
@@ -99,15 +117,6 @@ int NodeItem::childCount() const
 }
 
 
-/*
- *  Returns number of data columns the node has
- */
-int NodeItem::columnCount() const
-{
-    return _data.size();
-}
-
-
 /*
  *  Returns the node's position in the node list
  */
@@ -136,34 +145,39 @@ void NodeItem::setColor(const QColor& color)
 
 
 /*
- *  Sets the position of the node
+ *  Adds the child to the node. If it's already a child, it isn't added again,
+ *  but the times it has been added (e.g. a file included more than once) is counted.
  */
-void NodeItem::setPosition(const QPoint& position)
+void NodeItem::addChild(NodeItem *child, int multiplicity)
 {
-    _position = position;
+    QHash<quint32, int>::iterator found = _childMultiplicity.find(child->nameId());
+
+    if (found != _childMultiplicity.end()) {
+        found.value() += multiplicity;
+        return;
+    }
+
+    _children.append(child);
+    _childMultiplicity.insert(child->nameId(), multiplicity);
 }
 
 
 /*
- *  Adds the child to the node
+ *  Verifies if the node has a child with the supplied name id.
+ *  Returns true if that's the case, otherwise false.
  */
-void NodeItem::addChild(NodeItem *child)
+bool NodeItem::hasChild(quint32 childNameId) const
 {
-    _children.append(child);
+    return _childMultiplicity.contains(childNameId);
 }
 
 
 /*
- *  Verifies if the node has a child with the supplied name.
- *  Returns true if that's the case, otherwise false.
+ *  Returns the number of times [child] has been added to the node, 0 if it isn't a child
  */
-bool NodeItem::hasChild(const QString &nameOfChildNode) const
+int NodeItem::childMultiplicity(const NodeItem* child) const
 {
-    for (int i = 0; i < _children.size(); ++i) {
-        if (dynamic_cast<NodeItem*>(_children.at(i))->name() == nameOfChildNode)
-            return true;
-    }
-    return false;
+    return _childMultiplicity.value(child->nameId(), 0);
 }
 
 
@@ -184,7 +198,7 @@ bool NodeItem::hasChild(const QString &nameOfChildNode) const
  */
 bool NodeItem::operator==(const NodeItem &other) const
 {
-    if (_name == other.name())
+    if (_nameId == other.nameId())
         return true;
     else
         return false;
@@ -1,7 +1,9 @@
 /*
  * nodeitem.h
  *
- * NodeItem describes and represents the nodes, which could be xml-elements or files in other parsemodes
+ * NodeItem describes and represents the nodes, which could be xml-elements or files in other parsemodes.
+ * It's a plain class, the nodes of the node list are allocated from a NodeArena.
+ * The nodes only live while the files are parsed, the model keeps them in a NodeGraph after that.
  *
  * Mats Adborn, 2013-05-12
  */
@@ -10,63 +12,61 @@
 #ifndef NODEITEM_H
 #define NODEITEM_H
 
+#include "nametable.h"
 #include <QMetaType>
-#include <QObject>
 #include <QString>
 #include <QHash>
 #include <QVariant>
-#include <QPoint>
 #include <QColor>
 
 
-class NodeItem : public QObject
+class NodeItem
 {
-    Q_OBJECT
-
 public:
     enum Roles {
         NameRole = Qt::UserRole + 1,
         PositionRole,
         NumChildrenRole,
         ChildrenRole,
-        ColorRole
+        ColorRole,
+        LabelRole
     };
 
-    NodeItem() : QObject(0) {}
-    NodeItem(const NodeItem&);
-    explicit NodeItem(int index, const QString& name, const QColor& color = QColor(), QObject* parent = 0);
+    NodeItem() : _row(0), _nameId(NameTable::NO_ID), _labelId(NameTable::NO_ID) {}
+    explicit NodeItem(int index, const QString& name, const QColor& color = QColor());
+    explicit NodeItem(int index, quint32 nameId, const QColor& color = QColor());
 
     ~NodeItem();
 
     QString name() const;
+    quint32 nameId() const;
+    QString label() const;
+    quint32 labelId() const;
     QVariant data(int role) const;
 
     NodeItem* child(int row) const;
-    QList<NodeItem*>& children();
-    void addChild(NodeItem* child);
-    bool hasChild(const QString& nameOfChildNode) const;
+    const QList<NodeItem*>& children() const;
+    void addChild(NodeItem* child, int multiplicity = 1);
+    bool hasChild(quint32 childNameId) const;
+    int childMultiplicity(const NodeItem* child) const;
 
     int childCount() const;
-    int columnCount() const;
 
     int row() const;
 
     QColor color() const;
     void setColor(const QColor& color);
 
-    QPoint position() const;
-    void setPosition(const QPoint& position);
-
 //    QHash<int, QByteArray> roleNames() const;     // Unused
 
     bool operator==(const NodeItem& other) const;
 
 private:
     int _row;
-    QString _name;
-    QPoint _position;
-    QList<QVariant> _data;          // Unused...
-    QList<NodeItem*> _children;
+    quint32 _nameId;                // The name and label are interned, see NameTable
+    quint32 _labelId;
+    QList<NodeItem*> _children;                 // In the order they were added
+    QHash<quint32, int> _childMultiplicity;     // The times each child was added, by its name id
     QColor _color;
 };
 
@@ -1,15 +1,32 @@
 #include "nodeitemmodel.h"
+#include <QSet>
+#include <QtConcurrentRun>
+#include <climits>              // INT_MIN, INT_MAX
+
+static const int LAYOUT_SNAPSHOT_ITERATIONS = 10;  // Iterations between the positions shown while calculating
+static const int LAYOUT_SNAPSHOT_MS = 100;          // Time between looking for a new snapshot
+static const int SNAPSHOT_MARGIN = 100;             // Space around the nodes of a snapshot
 
 /*
  *  Constructor
  */
-NodeItemModel::NodeItemModel(QList<NodeItem*>& nodelist, QObject* parent)
-    : QAbstractListModel(parent), _nodelist(nodelist), _posCalc(new DistrShapePositionCalc(nodelist))
+NodeItemModel::NodeItemModel(QObject* parent)
+    : QAbstractListModel(parent), _posCalc(new DistrShapePositionCalc), _layoutRunning(false)
 {
+    _posCalc->setGraph(&_graph);
+    _snapshotTimer.setInterval(LAYOUT_SNAPSHOT_MS);
+
+    connect(&_snapshotTimer, SIGNAL(timeout()), this, SLOT(showLayoutSnapshot()));
+    connect(&_layoutWatcher, SIGNAL(finished()), this, SLOT(finishLayout()));
 }
 
+/*
+ *  Destructor, stops a running calculation before deleting the calculator
+ */
 NodeItemModel::~NodeItemModel()
 {
+    cancelLayout();
+    _layoutWatcher.waitForFinished();
     delete _posCalc;
 }
 
@@ -19,7 +36,7 @@ NodeItemModel::~NodeItemModel()
 int NodeItemModel::rowCount(const QModelIndex& parent) const
 {
     Q_UNUSED(parent);           // Suppress compiler warnings of the variable being unused
-    return _nodelist.size();
+    return _graph.nodeCount();
 }
 
 /*
@@ -27,27 +44,31 @@ int NodeItemModel::rowCount(const QModelIndex& parent) const
  */
 QVariant NodeItemModel::data(const QModelIndex& index, int role) const
 {
-    if (!index.isValid() && index.row() < _nodelist.size())
+    if (!index.isValid() || index.row() >= _graph.nodeCount())
         return QVariant();
 
-    if (role == Qt::DisplayRole)
-        return _nodelist.at(index.row())->data(NodeItem::NameRole);
+    const int row = index.row();
+
+    if (role == Qt::DisplayRole || role == NodeItem::LabelRole)
+        return _graph.label(row);
+
+    if (role == NodeItem::NameRole)
+        return _graph.name(row);
 
     if (role == NodeItem::PositionRole)
-        return _nodelist.at(index.row())->data(role);
+        return _graph.position(row);
 
     if (role == NodeItem::NumChildrenRole)
-        return _nodelist.at(index.row())->data(role);
+        return _graph.childCount(row);
 
     if (role == NodeItem::ColorRole)
-        return _nodelist.at(index.row())->data(role);
+        return _graph.color(row);
 
-    if (role == NodeItem::ChildrenRole) {               // This is NOT optimal code, but I couldn't get it to work with the Meta Object system
-        NodeItem* node = _nodelist.at(index.row());
+    if (role == NodeItem::ChildrenRole) {               // The view walks graph() instead, this is for other views
         QList<QVariant> pointslist;
 
-        foreach (NodeItem* child, node->children()) {
-            pointslist << QVariant(child->position());
+        for (int edge = _graph.childBegin(row); edge < _graph.childEnd(row); ++edge) {
+            pointslist << QVariant(_graph.position(_graph.childRow(edge)));
         }
 
         QVariant var = QVariant::fromValue(pointslist);
@@ -60,11 +81,14 @@ QVariant NodeItemModel::data(const QModelIndex& index, int role) const
 
 bool NodeItemModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    if (!index.isValid() && index.row() < _nodelist.size())
+    if (!index.isValid() || index.row() >= _graph.nodeCount())
         return false;
 
-    if (role == NodeItem::PositionRole) {
-        _nodelist.at(index.row())->setPosition(value.toPoint());
+    // The positions are the calculation's until it's done
+    if (role == NodeItem::PositionRole && !isLayoutRunning()) {
+        // A node placed by the user stays there when the map is updated, see applyChanges()
+        _graph.setPosition(index.row(), value.toPoint());
+        _graph.setPinned(index.row(), true);
         return true;
     }
 
@@ -86,12 +110,134 @@ QVariant NodeItemModel::headerData(int section, Qt::Orientation orientation, int
         return QString("Row %1").arg(section);
 }
 
+/*
+ *  Builds the graph of the model from the nodes the parsers created, replacing the nodes it had.
+ *  The model doesn't need [nodes] after this.
+ */
+void NodeItemModel::setNodes(const QList<NodeItem*>& nodes)
+{
+    beginResetModel();
+    _graph.build(nodes);
+    endResetModel();
+}
+
+/*
+ *  Replaces the calculator of the node positions (DistrShapePositionCalc by default).
+ *  The model takes over [posCalc] and deletes it when done.
+ */
+void NodeItemModel::setPositionCalc(AbstractNodeItemPositionCalc* posCalc)
+{
+    delete _posCalc;
+    _posCalc = posCalc;
+    _posCalc->setGraph(&_graph);
+}
+
 /*
  *  Asks the NodeItemPositionCalculator to recalculate the node positions
  */
 void NodeItemModel::recalculateNodePositions()
 {
+    beginResetModel();
     _posCalc->calculate();
+    endResetModel();
+}
+
+/*
+ *  Calculates the node positions on a worker thread, and returns at once. The rows are there
+ *  for the views from the start, and the positions published while calculating are shown as
+ *  they come (see showLayoutSnapshot()). When done, the nodes are moved to fit in their
+ *  geometric size with the top left corner at the origin, see finishLayout().
+ *  The graph must not be changed until layoutFinished() is emitted.
+ */
+void NodeItemModel::startLayout()
+{
+    if (isLayoutRunning())
+        return;
+
+    // The calculation works on a copy of the graph, which shares all but the positions with it
+    _layoutGraph = _graph;
+    _posCalc->setGraph(&_layoutGraph);
+
+    _layoutRunning = true;
+    _posCalc->setCanceled(false);
+    _posCalc->setSnapshotInterval(LAYOUT_SNAPSHOT_ITERATIONS);
+
+    _layoutWatcher.setFuture(QtConcurrent::run(_posCalc, &AbstractNodeItemPositionCalc::calculate));
+    _snapshotTimer.start();
+}
+
+/*
+ *  Asks a running calculation to stop. It's finished as usual, with the positions reached so far.
+ */
+void NodeItemModel::cancelLayout()
+{
+    if (isLayoutRunning())
+        _posCalc->setCanceled(true);
+}
+
+/*
+ *  Returns true while the positions are calculated on the worker thread, and until they
+ *  are moved into place by finishLayout()
+ */
+bool NodeItemModel::isLayoutRunning() const
+{
+    return _layoutRunning;
+}
+
+/*
+ *  Shows the latest positions published by the calculation, if any new, moved to have the
+ *  top left corner at the origin. The views are told about all rows in one go.
+ */
+void NodeItemModel::showLayoutSnapshot()
+{
+    QVector<QPoint> positions;
+
+    if (!_posCalc->takeSnapshot(positions) || positions.size() != _graph.nodeCount() || positions.isEmpty())
+        return;
+
+    int minX = INT_MAX, minY = INT_MAX,
+        maxX = INT_MIN, maxY = INT_MIN;
+
+    foreach (const QPoint& position, positions) {
+        minX = qMin(minX, position.x());
+        maxX = qMax(maxX, position.x());
+        minY = qMin(minY, position.y());
+        maxY = qMax(maxY, position.y());
+    }
+
+    const QPoint offset(SNAPSHOT_MARGIN - minX, SNAPSHOT_MARGIN - minY);
+
+    for (int row = 0; row < positions.size(); ++row) {
+        _graph.setPosition(row, positions.at(row) + offset);
+    }
+
+    emit geometricSizeChanged(QSize(maxX - minX + 2 * SNAPSHOT_MARGIN, maxY - minY + 2 * SNAPSHOT_MARGIN));
+    emit dataChanged(index(0), index(positions.size() - 1));
+}
+
+/*
+ *  Called when the calculation on the worker thread is done: moves the nodes to have the top
+ *  left corner of their geometric size at the origin, and shows them there
+ */
+void NodeItemModel::finishLayout()
+{
+    _snapshotTimer.stop();
+
+    // Nothing else changes the graph while calculating, so the copy takes its place
+    _graph = _layoutGraph;
+    _layoutGraph = NodeGraph();
+    _posCalc->setGraph(&_graph);
+
+    const QSize modelSize = _posCalc->modelGeometricSize();
+    moveNodePositions(QPoint(modelSize.width() / 2, modelSize.height() / 2));
+
+    emit geometricSizeChanged(modelSize);
+
+    if (_graph.nodeCount() > 0)
+        emit dataChanged(index(0), index(_graph.nodeCount() - 1));
+
+    _layoutRunning = false;
+    emit layoutFinished();
 }
 
 /*
@@ -117,3 +263,142 @@ void NodeItemModel::moveNodePositions(const QPoint &newCenterPoint)
 {
     _posCalc->moveInto(newCenterPoint);
 }
+
+/*
+ *  Applies the changes from a file parsed again (see AbstractNodeParser::reparseFile()) to the
+ *  graph, and tells the views about them: the removed and inserted rows, and the rows whose
+ *  children changed as one batch. Only the changed nodes and edges are touched, so the time
+ *  taken is in proportion to the changes and the edges of the nodes changed, not to the graph.
+ *  A removed node's row is taken by the last node, so the views are told the last rows are
+ *  removed, and the rows taken changed.
+ *  The added nodes are positioned next to the nodes they are connected with, and then refined
+ *  locally together with the nodes whose edges changed, moving their neighbours a little (see
+ *  AbstractNodeItemPositionCalc::relaxNodes()). The other nodes, and the nodes placed by the
+ *  user, stay where they are, and the geometric size grows if the moved nodes are outside it.
+ */
+void NodeItemModel::applyChanges(const NodeChanges& changes)
+{
+    QSet<quint32> changedNodes;             // The nodes whose edges changed
+    QSet<quint32> touchedNodes;             // The nodes that took the row of a removed one, or whose
+                                            // edges are only given a different number of times
+
+    foreach (const NodeChanges::Edge& edge, changes.removedEdges) {
+        const int parentRow = _graph.row(edge.first);
+        const int childRow = _graph.row(edge.second);
+
+        if (parentRow >= 0 && childRow >= 0)
+            _graph.removeEdge(parentRow, childRow);
+
+        changedNodes.insert(edge.first);
+        changedNodes.insert(edge.second);
+    }
+
+    int removedCount = 0;
+
+    foreach (quint32 nameId, changes.removedNodes) {
+        if (_graph.row(nameId) >= 0)
+            ++removedCount;
+    }
+
+    if (removedCount > 0) {
+        beginRemoveRows(QModelIndex(), _graph.nodeCount() - removedCount, _graph.nodeCount() - 1);
+
+        foreach (quint32 nameId, changes.removedNodes) {
+            const int row = _graph.row(nameId);
+
+            if (row >= 0 && _graph.removeNode(row) >= 0)
+                touchedNodes.insert(_graph.nameId(row));
+        }
+
+        endRemoveRows();
+    }
+
+    // The added nodes are appended, so they can be inserted as one range of rows
+    QList<QPair<quint32, QColor> > addedNodes;
+
+    for (int i = 0; i < changes.addedNodes.size(); ++i) {
+        if (_graph.row(changes.addedNodes.at(i).first) < 0)
+            addedNodes.append(changes.addedNodes.at(i));
+    }
+
+    QList<int> addedRows;
+
+    if (!addedNodes.isEmpty()) {
+        beginInsertRows(QModelIndex(), _graph.nodeCount(), _graph.nodeCount() + addedNodes.size() - 1);
+
+        for (int i = 0; i < addedNodes.size(); ++i)
+            addedRows.append(_graph.addNode(addedNodes.at(i).first, addedNodes.at(i).second));
+
+        endInsertRows();
+    }
+
+    for (int i = 0; i < changes.addedEdges.size(); ++i) {
+        const NodeChanges::Edge& edge = changes.addedEdges.at(i).first;
+        const int parentRow = _graph.row(edge.first);
+        const int childRow = _graph.row(edge.second);
+
+        if (parentRow >= 0 && childRow >= 0)
+            _graph.setEdge(parentRow, childRow, changes.addedEdges.at(i).second);
+
+        changedNodes.insert(edge.first);
+        changedNodes.insert(edge.second);
+    }
+
+    // The edges given a different number of times stay where they are
+    for (int i = 0; i < changes.changedEdges.size(); ++i) {
+        const NodeChanges::Edge& edge = changes.changedEdges.at(i).first;
+        const int parentRow = _graph.row(edge.first);
+        const int childRow = _graph.row(edge.second);
+
+        if (parentRow >= 0 && childRow >= 0) {
+            _graph.setEdge(parentRow, childRow, changes.changedEdges.at(i).second);
+            touchedNodes.insert(edge.first);
+        }
+    }
+
+    // The added nodes go first, in case there are more to relax than relaxNodes() moves
+    QList<int> changedRows;
+
+    foreach (quint32 nameId, changedNodes) {
+        const int row = _graph.row(nameId);
+
+        if (row >= 0 && row < _graph.nodeCount() - addedRows.size())
+            changedRows.append(row);
+    }
+
+    _posCalc->placeNodes(addedRows);
+    const QList<int> relaxedRows = _posCalc->relaxNodes(addedRows + changedRows);
+
+    // Tell about all changed and moved rows in one go
+    int firstRow = _graph.nodeCount();
+    int lastRow = -1;
+
+    foreach (int row, changedRows + relaxedRows) {
+        firstRow = qMin(firstRow, row);
+        lastRow = qMax(lastRow, row);
+    }
+
+    foreach (quint32 nameId, touchedNodes) {
+        const int row = _graph.row(nameId);
+
+        if (row >= 0) {
+            firstRow = qMin(firstRow, row);
+            lastRow = qMax(lastRow, row);
+        }
+    }
+
+    if (_posCalc->extendSize(relaxedRows + addedRows))
+        emit geometricSizeChanged(_posCalc->modelGeometricSize());
+
+    if (lastRow >= 0)
+        emit dataChanged(index(firstRow), index(lastRow));
+}
+
+
+/*
+ *  Returns the graph the model answers from, for views that walk the nodes and edges directly
+ */
+const NodeGraph& NodeItemModel::graph() const
+{
+    return _graph;
+}
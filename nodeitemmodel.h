@@ -3,6 +3,11 @@
  *
  * NodeItemModel is part of Qt's MVC pattern, representing the Model.
  * It contains the data (nodes) and responds to calls from the View and Delegate.
+ * The nodes are kept in a NodeGraph, built once from the node list the parsers created (see
+ * setNodes()) and changed in place after that (see applyChanges()). The position calculators
+ * work on the graph too.
+ * The positions may be calculated on a thread of their own (see startLayout()), the view showing
+ * the snapshots of the positions published while calculating.
  *
  * Mats Adborn, 2013-05-12
  */
@@ -11,11 +16,19 @@
 #define NODEITEMMODEL_H
 
 #include "nodeitem.h"
+#include "nodecreator.h"
 #include "abstractnodeitempositioncalc.h"
 #include "circleshapepositioncalc.h"
 #include "distrshapepositioncalc.h"
+#include "forceshapepositioncalc.h"
+#include "layershapepositioncalc.h"
+#include "multilevelshapepositioncalc.h"
+#include "stressshapepositioncalc.h"
+#include "nodegraph.h"
 #include <QAbstractListModel>
+#include <QFutureWatcher>
 #include <QList>
+#include <QTimer>
 
 
 class QSize;
@@ -25,7 +38,7 @@ class NodeItemModel : public QAbstractListModel
     Q_OBJECT
 
 public:
-    explicit NodeItemModel(QList<NodeItem*>& nodelist, QObject* parent = 0);
+    explicit NodeItemModel(QObject* parent = 0);
     ~NodeItemModel();
 
     int rowCount(const QModelIndex& parent = QModelIndex()) const;
@@ -33,14 +46,35 @@ public:
     bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole);
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
       
+    void setNodes(const QList<NodeItem*>& nodes);
+    void setPositionCalc(AbstractNodeItemPositionCalc* posCalc);
     void recalculateNodePositions();
+    void startLayout();
+    void cancelLayout();
+    bool isLayoutRunning() const;
     const QSize& modelGeometricSize() const;
     void scaleNodePositions(const QSize& sizeToFit);
     void moveNodePositions(const QPoint& newCenterPoint);
 
+    void applyChanges(const NodeChanges& changes);
+
+    const NodeGraph& graph() const;
+
+signals:
+    void geometricSizeChanged(const QSize& size);
+    void layoutFinished();
+
+private slots:
+    void showLayoutSnapshot();
+    void finishLayout();
+
 private:
-    QList<NodeItem*>& _nodelist;
+    NodeGraph _graph;
+    NodeGraph _layoutGraph;                 // The copy of the graph the calculation on the worker thread works on
     AbstractNodeItemPositionCalc* _posCalc;
+    QFutureWatcher<void> _layoutWatcher;    // Watches the calculation on the worker thread
+    bool _layoutRunning;                    // From startLayout() until finishLayout() is done
+    QTimer _snapshotTimer;                  // Looks for new snapshots while calculating
 };
 
 
@@ -1,6 +1,7 @@
 #include "nodeview.h"
 #include "nodeitemmodel.h"
 #include <QEvent>
+#include <QKeyEvent>
 #include <QResizeEvent>
 #include <QScrollBar>
 #include <QPainter>
@@ -22,8 +23,26 @@ NodeView::NodeView(const QSize& modelTargetSize, QWidget *parent)
     setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
 
-    resize(qMin(modelTargetWidth + verticalScrollBar()->width(), MIN_INITIAL_WIDTH),
-           qMin(modelTargetHeight + horizontalScrollBar()->height(), MIN_INITIAL_HEIGHT));
+    // Without a size yet (the positions are still being calculated), open at the largest initial size
+    if (modelTargetSize.isEmpty())
+        resize(MIN_INITIAL_WIDTH, MIN_INITIAL_HEIGHT);
+    else
+        resize(qMin(modelTargetWidth + verticalScrollBar()->width(), MIN_INITIAL_WIDTH),
+               qMin(modelTargetHeight + horizontalScrollBar()->height(), MIN_INITIAL_HEIGHT));
+}
+
+
+/*
+ *  Sets the size of the area the model's nodes are in, e.g. when they have been moved
+ *  by the layout, and updates the scrollbars to it
+ */
+void NodeView::setModelTargetSize(const QSize& modelTargetSize)
+{
+    modelTargetWidth = modelTargetSize.width();
+    modelTargetHeight = modelTargetSize.height();
+
+    updateGeometries();
+    viewport()->update();
 }
 
 /*
@@ -102,6 +121,26 @@ QModelIndex NodeView::indexAt(const QPoint &point) const
 }
 
 
+/*
+ *  Override of QAbstractItemView::rowsInserted() to show the nodes added to the model
+ */
+void NodeView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QAbstractItemView::rowsInserted(parent, start, end);
+    viewport()->update();
+}
+
+
+/*
+ *  Override of QAbstractItemView::rowsAboutToBeRemoved() to stop showing the nodes removed from the model
+ */
+void NodeView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    QAbstractItemView::rowsAboutToBeRemoved(parent, start, end);
+    viewport()->update();
+}
+
+
 /*
  *  Necessary implementation from QAbstractItemView
  *  Return the index of the next item when the user is pressing the keyboard arrow keys
@@ -208,6 +247,10 @@ void NodeView::paintEvent(QPaintEvent *)
     QModelIndex itemIndex;
     QStyleOptionViewItem itemOption;
 
+    // With a NodeItemModel, the connections are read straight from its graph
+    const NodeItemModel* nodeModel = qobject_cast<const NodeItemModel*>(model());
+    const NodeGraph* graph = nodeModel != NULL ? &nodeModel->graph() : NULL;
+
     // Loop through all items and paint them if they are inside the viewport
     for (int row = 0; row < model()->rowCount(); ++row) {
         itemRect = viewportRectForRow(row);
@@ -230,7 +273,7 @@ void NodeView::paintEvent(QPaintEvent *)
             itemOption.state |= QStyle::State_HasFocus;
 
         // Paint all of the nodes connection lines here, as the delegate won't know the viewport's location
-        paintConnections(itemIndex, &painter);
+        paintConnections(itemIndex, graph, &painter);
 
         // Ask the delegate to paint the item!
         itemDelegate()->paint(&painter, itemOption, itemIndex);
@@ -281,18 +324,28 @@ QRect NodeView::viewportRectForRow(int row) const
  *  This is essentially code that should be placed the delegate's paint(), but
  *  as the delegate doesn't know where the viewport is located, it had to be
  *  moved to the view instead.
+ *  The children are walked in [graph] if there is one, otherwise asked for through the model.
  */
-void NodeView::paintConnections(const QModelIndex &index, QPainter *painter) const
+void NodeView::paintConnections(const QModelIndex &index, const NodeGraph* graph, QPainter *painter) const
 {
     // Get the node's and all its children's center points
     QPoint nodePoint = viewportRectForRow(index.row()).center();
-    QList<QVariant> children = index.data(NodeItem::ChildrenRole).toList();
+    QList<QPoint> children;
+
+    if (graph != NULL) {
+        for (int edge = graph->childBegin(index.row()); edge < graph->childEnd(index.row()); ++edge)
+            children.append(graph->position(graph->childRow(edge)));
+    }
+    else {
+        foreach (const QVariant& child, index.data(NodeItem::ChildrenRole).toList())
+            children.append(child.toPoint());
+    }
 
     QPoint childPoint;
 
     // Loop through all children and draw the connections
     for (int child = 0; child < children.size(); ++child) {
-        childPoint = children.at(child).toPoint();
+        childPoint = children.at(child);
         childPoint.rx() -= horizontalScrollBar()->value();      // Compensate for viewport position
         childPoint.ry() -= verticalScrollBar()->value();
         drawArrowToEdge(painter, nodePoint, childPoint);
@@ -506,3 +559,20 @@ void NodeView::mouseReleaseEvent(QMouseEvent *event)
         dragIndex = QModelIndex();
     }
 }
+
+
+/*
+ *  keyPressEvent
+ *  Escape stops the layout of a NodeItemModel still calculating the positions
+ */
+void NodeView::keyPressEvent(QKeyEvent *event)
+{
+    NodeItemModel* nodeModel = qobject_cast<NodeItemModel*>(model());
+
+    if (event->key() == Qt::Key_Escape && nodeModel != NULL && nodeModel->isLayoutRunning()) {
+        nodeModel->cancelLayout();
+        return;
+    }
+
+    QAbstractItemView::keyPressEvent(event);
+}
@@ -11,10 +11,12 @@
 #define NODEVIEW_H
 
 #include <QAbstractItemView>
+#include <QPersistentModelIndex>
 #include <QWidget>
 #include <QObject>
 
 class QSize;
+class NodeGraph;
 
 class NodeView : public QAbstractItemView
 {
@@ -27,8 +29,12 @@ public:
     QModelIndex indexAt(const QPoint &point) const;
       
 public slots:
-    
+    void setModelTargetSize(const QSize& modelTargetSize);
+
 protected:
+    void rowsInserted(const QModelIndex &parent, int start, int end);
+    void rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+
     QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers);
     int horizontalOffset() const;
     int verticalOffset() const;
@@ -46,12 +52,13 @@ protected:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
+    void keyPressEvent(QKeyEvent *event);
 
 private:
     QRect rectForRow(int row) const;
     QRect viewportRectForRow(int row) const;
 
-    void paintConnections(const QModelIndex &index, QPainter* painter) const;
+    void paintConnections(const QModelIndex &index, const NodeGraph* graph, QPainter* painter) const;
     void drawArrowToEdge(QPainter* painter, const QPoint& start, const QPoint& end) const;
 
     int modelTargetWidth;
@@ -61,7 +68,7 @@ private:
     QPoint mouseLBDownOrigin;
     int mouseLBDownHScrollOrigin;
     int mouseLBDownVScrollOrigin;
-    QModelIndex dragIndex;
+    QPersistentModelIndex dragIndex;
 };
 
 #endif // NODEVIEW_H
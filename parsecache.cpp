@@ -0,0 +1,602 @@
+#include "parsecache.h"
+#include "nodearena.h"
+#include "nodeitem.h"
+#include <QColor>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>              // memcpy(), memcmp()
+
+// The cache file starts with a header, followed by the entries one after another:
+//     quint32 size of the entry in bytes (including this field)
+//     string  absolute path of the file
+//     quint64 hash of the context flags
+//     qint64  file size, qint64 modification time, quint64 content hash
+//     quint32 number of nodes, then for each node:
+//         string name, quint32 color (rgba), quint8 color is valid, quint32 number of children,
+//         then for each child quint32 index and quint32 multiplicity (the times it was added)
+//     quint32 number of found files, then each as a string
+// Strings are a quint32 length followed by UTF-8. Numbers are in the byte order of the machine,
+// which is checked by the header along with the format version.
+static const char MAGIC[4] = { 'V', 'N', 'P', 'C' };
+static const quint32 VERSION = 2;
+static const quint32 BYTE_ORDER_MARK = 0x01020304;
+static const int HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(quint32);
+
+// The multipliers of xxHash64
+static const quint64 PRIME64_1 = 11400714785074694791ULL;
+static const quint64 PRIME64_2 = 14029467366897019727ULL;
+static const quint64 PRIME64_3 = 1609587929392839161ULL;
+static const quint64 PRIME64_4 = 9650029242287828579ULL;
+static const quint64 PRIME64_5 = 2870177450012600261ULL;
+
+
+/*
+ *  Reads the values of an entry, checking that they're within the entry
+ */
+class EntryReader
+{
+public:
+    EntryReader(const char* pos, const char* end) : _pos(pos), _end(end), _ok(true) {}
+
+    template <typename T>
+    T read()
+    {
+        T value = T();
+
+        if (_end - _pos < static_cast<qint64>(sizeof(T))) {
+            _ok = false;
+            return value;
+        }
+
+        memcpy(&value, _pos, sizeof(T));
+        _pos += sizeof(T);
+
+        return value;
+    }
+
+    QString readString()
+    {
+        const quint32 length = read<quint32>();
+
+        if (!_ok || static_cast<quint64>(_end - _pos) < length) {
+            _ok = false;
+            return QString();
+        }
+
+        QString value = QString::fromUtf8(_pos, static_cast<int>(length));
+        _pos += length;
+
+        return value;
+    }
+
+    bool ok() const { return _ok; }
+
+private:
+    const char* _pos;
+    const char* _end;
+    bool _ok;
+};
+
+
+/*
+ *  Appends a number to an encoded entry
+ */
+template <typename T>
+static inline void appendValue(QByteArray& data, T value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+/*
+ *  Appends a string to an encoded entry
+ */
+static inline void appendString(QByteArray& data, const QString& value)
+{
+    const QByteArray utf8 = value.toUtf8();
+
+    appendValue<quint32>(data, utf8.size());
+    data.append(utf8);
+}
+
+
+/*
+ *  Returns the size of the entry at [entry], found at its start
+ */
+static inline quint32 entrySize(const char* entry)
+{
+    quint32 size;
+    memcpy(&size, entry, sizeof(size));
+    return size;
+}
+
+
+/*
+ *  Constructor
+ */
+ParseCache::ParseCache()
+    : _mapped(NULL)
+{
+}
+
+
+/*
+ *  Destructor. Note that the cache isn't saved automatically.
+ */
+ParseCache::~ParseCache()
+{
+    if (_mapped != NULL)
+        _file.unmap(_mapped);
+}
+
+
+/*
+ *  Opens the cache file, to be used for lookups and written by save().
+ *  A missing file gives an empty cache. Returns false if the file isn't a valid cache
+ *  (e.g. written by another version), in which case the cache is empty but still usable.
+ */
+bool ParseCache::open(const QString& fileName)
+{
+    _fileName = fileName;
+    _file.setFileName(fileName);
+
+    if (!_file.exists())
+        return true;
+
+    if (!_file.open(QFile::ReadOnly))
+        return false;
+
+    const qint64 size = _file.size();
+    const char* data;
+
+    if (size > 0)
+        _mapped = _file.map(0, size);
+
+    // If the file can't be mapped, read it into memory instead
+    if (_mapped != NULL) {
+        data = reinterpret_cast<const char*>(_mapped);
+    }
+    else {
+        _buffer = _file.readAll();
+        data = _buffer.constData();
+    }
+
+    return size == 0 || buildIndex(data, data + size);
+}
+
+
+/*
+ *  Indexes the entries of the cache file [data, end), only reading their keys.
+ *  A bad header or a broken entry makes the whole cache be ignored, and false is returned.
+ */
+bool ParseCache::buildIndex(const char* data, const char* end)
+{
+    EntryReader header(data, end);
+
+    for (unsigned int i = 0; i < sizeof(MAGIC); ++i) {
+        if (header.read<char>() != MAGIC[i])
+            return false;
+    }
+
+    if (header.read<quint32>() != VERSION || header.read<quint32>() != BYTE_ORDER_MARK || !header.ok())
+        return false;
+
+    const char* pos = data + HEADER_SIZE;
+
+    while (pos < end) {
+        if (end - pos < static_cast<qint64>(sizeof(quint32)) || entrySize(pos) < sizeof(quint32) ||
+            entrySize(pos) > static_cast<quint64>(end - pos)) {
+            _index.clear();
+            return false;
+        }
+
+        EntryReader entry(pos + sizeof(quint32), pos + entrySize(pos));
+        const QString path = entry.readString();
+        const quint64 flagsHash = entry.read<quint64>();
+
+        if (!entry.ok()) {
+            _index.clear();
+            return false;
+        }
+
+        _index.insert(Key(path, flagsHash), pos);
+        pos += entrySize(pos);
+    }
+
+    return true;
+}
+
+
+/*
+ *  Writes the entries used in this run (looked up or stored) to the cache file, replacing it.
+ *  Nothing is written if nothing changed. Returns false if the file couldn't be written.
+ *  Must be called when parsing is done, the cache is empty afterwards.
+ */
+bool ParseCache::save()
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_fileName.isEmpty())
+        return false;
+
+    if (_stored.isEmpty() && _used.size() == _index.size())
+        return true;
+
+    QSaveFile file(_fileName);
+
+    if (!file.open(QFile::WriteOnly))
+        return false;
+
+    QByteArray header;
+    header.append(MAGIC, sizeof(MAGIC));
+    appendValue<quint32>(header, VERSION);
+    appendValue<quint32>(header, BYTE_ORDER_MARK);
+    file.write(header);
+
+    // The unchanged entries are copied as they are
+    QHash<Key, const char*>::const_iterator it;
+
+    for (it = _index.constBegin(); it != _index.constEnd(); ++it) {
+        if (_used.contains(it.key()) && !_stored.contains(it.key()))
+            file.write(it.value(), entrySize(it.value()));
+    }
+
+    foreach (const QByteArray& entry, _stored) {
+        file.write(entry);
+    }
+
+    // Let go of the old file before replacing it
+    _index.clear();
+    _used.clear();
+    _stored.clear();
+    _buffer.clear();
+
+    if (_mapped != NULL) {
+        _file.unmap(_mapped);
+        _mapped = NULL;
+    }
+    _file.close();
+
+    return file.commit();
+}
+
+
+/*
+ *  Looks up the parse result of [fileName], parsed with [contextFlags] (a description of how
+ *  the file is parsed, see AbstractNodeParser::contextFlags()). If the file is unchanged since
+ *  it was stored, [nodes] and [foundFiles] are filled in and true is returned. The nodes are
+ *  allocated from [nodeArena], which owns them.
+ *  [stamp] is set to the file's current state, to be given to store() if the file is parsed.
+ */
+bool ParseCache::lookup(const QString& fileName, const QString& contextFlags, FileStamp& stamp,
+                        NodeArena& nodeArena, QList<NodeItem*>& nodes, QStringList& foundFiles)
+{
+    const QFileInfo info(fileName);
+
+    stamp = FileStamp();
+
+    if (!info.isFile())
+        return false;
+
+    stamp.size = info.size();
+    stamp.modified = info.lastModified().toMSecsSinceEpoch();
+
+    const QByteArray flags = contextFlags.toUtf8();
+    const Key key(info.absoluteFilePath(), hash(flags.constData(), flags.size()));
+    QByteArray storedEntry;
+    const char* entry = NULL;
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        if (_stored.contains(key))
+            storedEntry = _stored.value(key);
+        else
+            entry = _index.value(key, NULL);
+    }
+
+    if (!storedEntry.isNull())
+        entry = storedEntry.constData();
+
+    // Only the sizes and times are compared at first, the contents are only hashed when needed
+    FileStamp cached;
+    bool found = entry != NULL && decodeEntry(entry, cached, NULL, NULL, NULL);
+    bool touched = false;
+
+    if (found && (cached.size != stamp.size || cached.modified != stamp.modified)) {
+        found = false;
+
+        if (cached.size == stamp.size && hashFile(fileName, stamp.hash)) {
+            stamp.valid = true;
+            found = (stamp.hash == cached.hash);
+            touched = found;             // E.g. a checkout that only changed the file's time
+        }
+    }
+
+    if (found && !decodeEntry(entry, cached, &nodeArena, &nodes, &foundFiles))
+        found = false;
+
+    if (!found) {
+        if (!stamp.valid)
+            stamp.valid = hashFile(fileName, stamp.hash);
+        return false;
+    }
+
+    stamp.hash = cached.hash;
+    stamp.valid = true;
+
+    if (touched) {
+        store(fileName, contextFlags, stamp, nodes, foundFiles);
+    }
+    else {
+        QMutexLocker locker(&_mutex);
+        _used.insert(key);
+    }
+
+    return true;
+}
+
+
+/*
+ *  Stores the parse result of [fileName], parsed with [contextFlags]. [stamp] is the one
+ *  given by lookup() before the file was parsed.
+ */
+void ParseCache::store(const QString& fileName, const QString& contextFlags, const FileStamp& stamp,
+                       const QList<NodeItem*>& nodes, const QStringList& foundFiles)
+{
+    if (!stamp.valid)
+        return;
+
+    const QByteArray flags = contextFlags.toUtf8();
+    const Key key(QFileInfo(fileName).absoluteFilePath(), hash(flags.constData(), flags.size()));
+    const QByteArray entry = encodeEntry(key, stamp, nodes, foundFiles);
+
+    QMutexLocker locker(&_mutex);
+    _stored.insert(key, entry);
+}
+
+
+/*
+ *  Decodes the entry at [entry] into [stamp], and into [nodes] and [foundFiles] unless they are NULL.
+ *  The nodes are allocated from [nodeArena]. Returns false if the entry is broken.
+ */
+bool ParseCache::decodeEntry(const char* entry, FileStamp& stamp, NodeArena* nodeArena, QList<NodeItem*>* nodes,
+                             QStringList* foundFiles) const
+{
+    EntryReader reader(entry + sizeof(quint32), entry + entrySize(entry));
+
+    reader.readString();                // The path and the flags' hash are already known from the key
+    reader.read<quint64>();
+
+    stamp.size = reader.read<qint64>();
+    stamp.modified = reader.read<qint64>();
+    stamp.hash = reader.read<quint64>();
+    stamp.valid = reader.ok();
+
+    if (nodes == NULL || !reader.ok())
+        return reader.ok();
+
+    const quint32 nodeCount = reader.read<quint32>();
+    QList<QList<QPair<quint32, quint32> > > children;     // Index and multiplicity of each node's children
+
+    for (quint32 i = 0; i < nodeCount && reader.ok(); ++i) {
+        const QString name = reader.readString();
+        const QRgb rgba = reader.read<quint32>();
+        const bool colorValid = reader.read<quint8>() != 0;
+
+        nodes->append(nodeArena->create(static_cast<int>(i), NameTable::intern(name),
+                                        colorValid ? QColor::fromRgba(rgba) : QColor()));
+
+        children.append(QList<QPair<quint32, quint32> >());
+        const quint32 childCount = reader.read<quint32>();
+
+        for (quint32 j = 0; j < childCount && reader.ok(); ++j) {
+            const quint32 child = reader.read<quint32>();
+            children.last().append(qMakePair(child, reader.read<quint32>()));
+        }
+    }
+
+    const quint32 foundCount = reader.read<quint32>();
+
+    for (quint32 i = 0; i < foundCount && reader.ok(); ++i)
+        foundFiles->append(reader.readString());
+
+    bool ok = reader.ok();
+
+    // Connect the nodes when they all exist, the child indices must be within the entry's nodes
+    for (int i = 0; i < children.size() && ok; ++i) {
+        for (int j = 0; j < children.at(i).size(); ++j) {
+            const quint32 child = children.at(i).at(j).first;
+            const quint32 multiplicity = children.at(i).at(j).second;
+
+            if (child >= static_cast<quint32>(nodes->size()) || multiplicity == 0) {
+                ok = false;
+                break;
+            }
+
+            nodes->at(i)->addChild(nodes->at(child), static_cast<int>(multiplicity));
+        }
+    }
+
+    // On failure the nodes created so far stay in the arena until it's cleared
+    if (!ok) {
+        nodes->clear();
+        foundFiles->clear();
+    }
+
+    return ok;
+}
+
+
+/*
+ *  Encodes an entry, see the format at the top of the file
+ */
+QByteArray ParseCache::encodeEntry(const Key& key, const FileStamp& stamp,
+                                   const QList<NodeItem*>& nodes, const QStringList& foundFiles)
+{
+    QByteArray entry;
+    QHash<NodeItem*, quint32> nodeIndex;
+
+    for (int i = 0; i < nodes.size(); ++i)
+        nodeIndex.insert(nodes.at(i), i);
+
+    appendValue<quint32>(entry, 0);     // The size, set when known
+    appendString(entry, key.first);
+    appendValue<quint64>(entry, key.second);
+    appendValue<qint64>(entry, stamp.size);
+    appendValue<qint64>(entry, stamp.modified);
+    appendValue<quint64>(entry, stamp.hash);
+
+    appendValue<quint32>(entry, nodes.size());
+
+    foreach (NodeItem* node, nodes) {
+        appendString(entry, node->name());
+        appendValue<quint32>(entry, node->color().rgba());
+        appendValue<quint8>(entry, node->color().isValid() ? 1 : 0);
+        appendValue<quint32>(entry, node->childCount());
+
+        foreach (NodeItem* child, node->children()) {
+            appendValue<quint32>(entry, nodeIndex.value(child));
+            appendValue<quint32>(entry, node->childMultiplicity(child));
+        }
+    }
+
+    appendValue<quint32>(entry, foundFiles.size());
+
+    foreach (const QString& foundFile, foundFiles)
+        appendString(entry, foundFile);
+
+    const quint32 size = entry.size();
+    memcpy(entry.data(), &size, sizeof(size));
+
+    return entry;
+}
+
+
+/*
+ *  Hashes the contents of a file. Returns false if it can't be read.
+ */
+bool ParseCache::hashFile(const QString& fileName, quint64& hash)
+{
+    QFile file(fileName);
+
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    const qint64 size = file.size();
+    uchar* mapped = size > 0 ? file.map(0, size) : NULL;
+
+    if (mapped != NULL) {
+        hash = ParseCache::hash(reinterpret_cast<const char*>(mapped), size);
+        file.unmap(mapped);
+        return true;
+    }
+
+    const QByteArray contents = file.readAll();
+
+    if (file.error() != QFile::NoError)
+        return false;
+
+    hash = ParseCache::hash(contents.constData(), contents.size());
+
+    return true;
+}
+
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 read64(const char* pos)
+{
+    quint64 value;
+    memcpy(&value, pos, sizeof(value));
+    return value;
+}
+
+static inline quint32 read32(const char* pos)
+{
+    quint32 value;
+    memcpy(&value, pos, sizeof(value));
+    return value;
+}
+
+static inline quint64 hashRound(quint64 acc, quint64 input)
+{
+    acc += input * PRIME64_2;
+    acc = rotateLeft(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= hashRound(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+/*
+ *  Returns the xxHash64 (seed 0) of [data], which hashes at memory speed.
+ *  The data is read as little endian words, as on the machines it's used on.
+ */
+quint64 ParseCache::hash(const char* data, qint64 length)
+{
+    const char* pos = data;
+    const char* end = data + length;
+    quint64 hash;
+
+    if (length >= 32) {
+        quint64 v1 = PRIME64_1 + PRIME64_2;
+        quint64 v2 = PRIME64_2;
+        quint64 v3 = 0;
+        quint64 v4 = 0 - PRIME64_1;
+
+        // Four independent lanes of 8 bytes each
+        do {
+            v1 = hashRound(v1, read64(pos));
+            v2 = hashRound(v2, read64(pos + 8));
+            v3 = hashRound(v3, read64(pos + 16));
+            v4 = hashRound(v4, read64(pos + 24));
+            pos += 32;
+        } while (end - pos >= 32);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else {
+        hash = PRIME64_5;
+    }
+
+    hash += static_cast<quint64>(length);
+
+    // The remaining 0-31 bytes
+    for (; end - pos >= 8; pos += 8) {
+        hash ^= hashRound(0, read64(pos));
+        hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (end - pos >= 4) {
+        hash ^= static_cast<quint64>(read32(pos)) * PRIME64_1;
+        hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        pos += 4;
+    }
+
+    for (; pos < end; ++pos) {
+        hash ^= static_cast<unsigned char>(*pos) * PRIME64_5;
+        hash = rotateLeft(hash, 11) * PRIME64_1;
+    }
+
+    // Final mix
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
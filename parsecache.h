@@ -0,0 +1,77 @@
+/*
+ * parsecache.h
+ *
+ * ParseCache keeps the results of parsed files between runs: for each file (and parsing context)
+ * its size, modification time and xxHash64 content hash, together with the nodes and found files
+ * its parsing gave. A file whose size and time (or, failing that, content hash) are unchanged
+ * doesn't need to be parsed again.
+ *
+ * The cache is a compact binary file that is memory mapped when opened. Only an index of the
+ * entries is built up front, an entry is decoded when its file is looked up. The file is written
+ * anew by save(), keeping only the entries used in the run, so removed files don't linger.
+ * Lookups and stores are thread-safe.
+ */
+
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class NodeArena;
+class NodeItem;
+
+class ParseCache
+{
+public:
+    // The state of a file on disk when it was looked up, to be stored with its parse result
+    struct FileStamp {
+        FileStamp() : valid(false), size(0), modified(0), hash(0) {}
+        bool valid;
+        qint64 size;
+        qint64 modified;        // Milliseconds since the epoch
+        quint64 hash;
+    };
+
+    ParseCache();
+    ~ParseCache();
+
+    bool open(const QString& fileName);
+    bool save();
+
+    bool lookup(const QString& fileName, const QString& contextFlags, FileStamp& stamp,
+                NodeArena& nodeArena, QList<NodeItem*>& nodes, QStringList& foundFiles);
+    void store(const QString& fileName, const QString& contextFlags, const FileStamp& stamp,
+               const QList<NodeItem*>& nodes, const QStringList& foundFiles);
+
+    static quint64 hash(const char* data, qint64 length);
+
+private:
+    typedef QPair<QString, quint64> Key;        // Absolute file path and hash of the context flags
+
+    bool buildIndex(const char* data, const char* end);
+    bool decodeEntry(const char* entry, FileStamp& stamp, NodeArena* nodeArena, QList<NodeItem*>* nodes,
+                     QStringList* foundFiles) const;
+    static QByteArray encodeEntry(const Key& key, const FileStamp& stamp,
+                                  const QList<NodeItem*>& nodes, const QStringList& foundFiles);
+    static bool hashFile(const QString& fileName, quint64& hash);
+
+    QString _fileName;
+    QFile _file;
+    uchar* _mapped;
+    QByteArray _buffer;                 // The cache's contents if it couldn't be mapped
+
+    QMutex _mutex;
+    QHash<Key, const char*> _index;     // The entries of the cache file, by key
+    QSet<Key> _used;                    // The entries of the cache file used in this run
+    QHash<Key, QByteArray> _stored;     // New and updated entries, encoded
+};
+
+#endif // PARSECACHE_H
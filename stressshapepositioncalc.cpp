@@ -0,0 +1,452 @@
+#include "stressshapepositioncalc.h"
+#include "nodegraph.h"
+#include <QHash>
+#include <QPair>
+#include <qmath.h>
+
+// Define some constants for ease of use when tweaking and debugging
+static const qreal STRESS_SHAPE_EDGE_LENGTH = 100.0;       // The length in the map of one edge in the graph
+static const int STRESS_SHAPE_PIVOTS = 50;
+static const int STRESS_SHAPE_POWER_ITERATIONS = 200;      // The most iterations for finding an eigenvector
+static const int STRESS_SHAPE_MAX_ITERATIONS = 100;
+static const qreal STRESS_SHAPE_CONVERGENCE = 0.001;       // Done when no node moves further than this (in edges)
+static const qreal STRESS_SHAPE_MIN_DISTANCE = 0.5;        // Nodes closer than this (in edges) are moved apart
+static const int STRESS_SHAPE_MAX_CLOSE_NODES = 32;        // The most nodes a node is moved apart from in an iteration
+
+
+/*
+ *  Adds the wish of a node at ([x], [y]) to be [distance] from the node at ([otherX], [otherY]),
+ *  i.e. the point at that distance on the line between them, weighted by [weight].
+ *  A node at the same spot as the other one is moved apart in the direction [angle].
+ */
+static inline void addStressTerm(qreal x, qreal y, qreal otherX, qreal otherY, qreal distance, qreal weight,
+                                 qreal angle, qreal& sumX, qreal& sumY, qreal& weights)
+{
+    const qreal dx = x - otherX;
+    const qreal dy = y - otherY;
+    const qreal length = qSqrt(dx * dx + dy * dy);
+
+    if (length > 1e-9) {
+        sumX += weight * (otherX + distance * dx / length);
+        sumY += weight * (otherY + distance * dy / length);
+    }
+    else {
+        sumX += weight * (otherX + distance * qCos(angle));
+        sumY += weight * (otherY + distance * qSin(angle));
+    }
+
+    weights += weight;
+}
+
+
+/*
+ *  Finds the eigenvector of the symmetric [size] x [size] [matrix] with the largest
+ *  eigenvalue, by power iteration from [vector], which is set to it. If [orthogonalTo]
+ *  isn't empty, the eigenvector is the largest one orthogonal to it.
+ */
+static void powerIteration(const QVector<qreal>& matrix, int size, QVector<qreal>& vector,
+                           const QVector<qreal>& orthogonalTo)
+{
+    QVector<qreal> product(size);
+
+    for (int iteration = 0; iteration < STRESS_SHAPE_POWER_ITERATIONS; ++iteration) {
+        for (int i = 0; i < size; ++i) {
+            qreal sum = 0.0;
+
+            for (int j = 0; j < size; ++j) {
+                sum += matrix.at(i * size + j) * vector.at(j);
+            }
+
+            product[i] = sum;
+        }
+
+        if (!orthogonalTo.isEmpty()) {
+            qreal dot = 0.0;
+
+            for (int i = 0; i < size; ++i) {
+                dot += product.at(i) * orthogonalTo.at(i);
+            }
+
+            for (int i = 0; i < size; ++i) {
+                product[i] -= dot * orthogonalTo.at(i);
+            }
+        }
+
+        qreal length = 0.0;
+
+        for (int i = 0; i < size; ++i) {
+            length += product.at(i) * product.at(i);
+        }
+
+        length = qSqrt(length);
+
+        if (length < 1e-12)
+            return;             // No more to find, e.g. the nodes all on a line
+
+        qreal change = 0.0;
+
+        for (int i = 0; i < size; ++i) {
+            const qreal value = product.at(i) / length;
+
+            change += qAbs(value - vector.at(i));
+            vector[i] = value;
+        }
+
+        if (change < 1e-10)
+            return;
+    }
+}
+
+
+/*
+ *  Constructor
+ */
+StressShapePositionCalc::StressShapePositionCalc()
+{
+}
+
+/*
+ *  Calculates the positions of all nodes, centered around the origin
+ */
+void StressShapePositionCalc::calculate()
+{
+    stressShape();
+}
+
+/*
+ *  Creates the node map, see the steps in the header. The layout is calculated with one
+ *  edge as the unit, then scaled up and centered around the origin.
+ */
+void StressShapePositionCalc::stressShape()
+{
+    if (_graph->nodeCount() == 0)
+        return;
+
+    collectNeighbours(_neighbourOffsets, _neighbours);
+    choosePivots();
+    measureDistances();
+    pivotMds();
+    majorizeStress();
+
+    const QVector<QPoint> points = positions();
+
+    for (int row = 0; row < _graph->nodeCount(); ++row) {
+        _graph->setPosition(row, points.at(row));
+    }
+
+    // The buffers are only needed while calculating
+    _neighbourOffsets.clear();
+    _neighbours.clear();
+    _pivots.clear();
+    _distances.clear();
+    _regionSizes.clear();
+    _x.clear();
+    _y.clear();
+
+    calculateCurrentSize();
+}
+
+/*
+ *  Returns the positions by row, scaled up from edges and centered around the origin
+ */
+QVector<QPoint> StressShapePositionCalc::positions() const
+{
+    qreal minX = _x.first(), maxX = minX;
+    qreal minY = _y.first(), maxY = minY;
+
+    for (int row = 0; row < _x.size(); ++row) {
+        minX = qMin(minX, _x.at(row));
+        maxX = qMax(maxX, _x.at(row));
+        minY = qMin(minY, _y.at(row));
+        maxY = qMax(maxY, _y.at(row));
+    }
+
+    QVector<QPoint> points(_x.size());
+
+    for (int row = 0; row < _x.size(); ++row) {
+        const qreal x = (_x.at(row) - (minX + maxX) / 2.0) * STRESS_SHAPE_EDGE_LENGTH;
+        const qreal y = (_y.at(row) - (minY + maxY) / 2.0) * STRESS_SHAPE_EDGE_LENGTH;
+
+        points[row] = QPoint(qRound(x), qRound(y));
+    }
+
+    return points;
+}
+
+/*
+ *  Picks the pivots spread evenly over the node list. Picking each one as far as possible from
+ *  the ones before would spread them better over the graph, but would need the searches to be
+ *  run one after another.
+ */
+void StressShapePositionCalc::choosePivots()
+{
+    const int count = nodeCount();
+    const int pivots = qMin(STRESS_SHAPE_PIVOTS, count);
+
+    _pivots.resize(pivots);
+
+    for (int pivot = 0; pivot < pivots; ++pivot) {
+        _pivots[pivot] = static_cast<qint64>(pivot) * count / pivots;
+    }
+}
+
+/*
+ *  Finds the distances from all pivots on all threads, a pivot per task (see runTasks()), and
+ *  the number of nodes closest to each pivot (the one first in the list, for nodes as close to
+ *  several)
+ */
+void StressShapePositionCalc::measureDistances()
+{
+    const int count = nodeCount();
+    const int pivots = _pivots.size();
+
+    _distances.resize(pivots * count);
+    runTasks(pivots);
+
+    _regionSizes.fill(0, pivots);
+
+    for (int row = 0; row < count; ++row) {
+        int closest = 0;
+
+        for (int pivot = 1; pivot < pivots; ++pivot) {
+            if (distance(pivot, row) < distance(closest, row))
+                closest = pivot;
+        }
+
+        ++_regionSizes[closest];
+    }
+}
+
+/*
+ *  Searches from pivot [task]
+ */
+void StressShapePositionCalc::runTask(int task)
+{
+    measureDistancesFrom(task);
+}
+
+/*
+ *  Finds the distance in edges, either way, from [pivot] to all nodes with a breadth-first
+ *  search. The nodes it can't reach are put one edge further away than the farthest it can,
+ *  which keeps the parts of a graph in pieces near each other.
+ */
+void StressShapePositionCalc::measureDistancesFrom(int pivot)
+{
+    const int count = nodeCount();
+    int* distances = _distances.data() + pivot * count;
+    QVector<int> queue(count);
+    int head = 0, tail = 0;
+
+    for (int row = 0; row < count; ++row) {
+        distances[row] = -1;
+    }
+
+    distances[_pivots.at(pivot)] = 0;
+    queue[tail++] = _pivots.at(pivot);
+
+    while (head < tail) {
+        const int row = queue.at(head++);
+
+        for (int i = _neighbourOffsets.at(row); i < _neighbourOffsets.at(row + 1); ++i) {
+            const int neighbour = _neighbours.at(i);
+
+            if (distances[neighbour] < 0) {
+                distances[neighbour] = distances[row] + 1;
+                queue[tail++] = neighbour;
+            }
+        }
+    }
+
+    const int unreachable = distances[queue.at(tail - 1)] + 1;
+
+    for (int row = 0; row < count; ++row) {
+        if (distances[row] < 0)
+            distances[row] = unreachable;
+    }
+}
+
+/*
+ *  Places the nodes by Pivot MDS: the squared distances to the pivots are double centered
+ *  into the n x k matrix C, and the coordinates are C times the two largest eigenvectors of
+ *  the k x k matrix C^T C. The result is scaled to a mean edge length of 1.
+ */
+void StressShapePositionCalc::pivotMds()
+{
+    const int count = nodeCount();
+    const int pivots = _pivots.size();
+    QVector<qreal> centered(count * pivots);            // Node by node
+    QVector<qreal> rowMeans(count, 0.0);
+    QVector<qreal> pivotMeans(pivots, 0.0);
+    qreal mean = 0.0;
+
+    for (int row = 0; row < count; ++row) {
+        for (int pivot = 0; pivot < pivots; ++pivot) {
+            const qreal squared = static_cast<qreal>(distance(pivot, row)) * distance(pivot, row);
+
+            centered[row * pivots + pivot] = squared;
+            rowMeans[row] += squared / pivots;
+            pivotMeans[pivot] += squared / count;
+            mean += squared / count / pivots;
+        }
+    }
+
+    for (int row = 0; row < count; ++row) {
+        for (int pivot = 0; pivot < pivots; ++pivot) {
+            qreal& value = centered[row * pivots + pivot];
+
+            value = -0.5 * (value - rowMeans.at(row) - pivotMeans.at(pivot) + mean);
+        }
+    }
+
+    QVector<qreal> product(pivots * pivots, 0.0);      // C^T C
+
+    for (int row = 0; row < count; ++row) {
+        const qreal* values = centered.constData() + row * pivots;
+
+        for (int i = 0; i < pivots; ++i) {
+            for (int j = 0; j < pivots; ++j) {
+                product[i * pivots + j] += values[i] * values[j];
+            }
+        }
+    }
+
+    // Start from vectors unlikely to be orthogonal to the eigenvectors
+    QVector<qreal> first(pivots);
+    QVector<qreal> second(pivots);
+
+    for (int i = 0; i < pivots; ++i) {
+        first[i] = 1.0 + i;
+        second[i] = (i % 2 == 0 ? 1.0 : -1.0) * (pivots - i);
+    }
+
+    powerIteration(product, pivots, first, QVector<qreal>());
+    powerIteration(product, pivots, second, first);
+
+    _x.resize(count);
+    _y.resize(count);
+
+    for (int row = 0; row < count; ++row) {
+        qreal x = 0.0, y = 0.0;
+
+        for (int pivot = 0; pivot < pivots; ++pivot) {
+            x += centered.at(row * pivots + pivot) * first.at(pivot);
+            y += centered.at(row * pivots + pivot) * second.at(pivot);
+        }
+
+        _x[row] = x;
+        _y[row] = y;
+    }
+
+    qreal edgeLengths = 0.0;
+
+    for (int row = 0; row < count; ++row) {
+        for (int i = _neighbourOffsets.at(row); i < _neighbourOffsets.at(row + 1); ++i) {
+            const qreal dx = _x.at(row) - _x.at(_neighbours.at(i));
+            const qreal dy = _y.at(row) - _y.at(_neighbours.at(i));
+
+            edgeLengths += qSqrt(dx * dx + dy * dy);
+        }
+    }
+
+    if (edgeLengths > 0.0) {
+        const qreal scale = _neighbours.size() / edgeLengths;
+
+        for (int row = 0; row < count; ++row) {
+            _x[row] *= scale;
+            _y[row] *= scale;
+        }
+    }
+}
+
+/*
+ *  Refines the placement by sparse stress majorization. Each node in turn is moved to the
+ *  weighted mean of where it would be at the right distance from:
+ *    - its neighbours, one edge
+ *    - the pivots, their distance in the graph, weighted by the number of nodes closest to
+ *      the pivot over the squared distance (the pivot stands in for the nodes around it)
+ *    - nodes closer than the minimum distance, that distance, weighted as much as all of
+ *      the above together
+ *  The nodes close to each one are found in a grid of the positions at the start of each
+ *  iteration, with cells of the minimum distance.
+ */
+void StressShapePositionCalc::majorizeStress()
+{
+    const int count = nodeCount();
+    const int pivots = _pivots.size();
+    QHash<QPair<int, int>, int> cellHeads;          // The last node put in each cell of the grid
+    QVector<int> nextInCell(count);                 // The node put in the cell before each node
+
+    for (int iteration = 0; iteration < STRESS_SHAPE_MAX_ITERATIONS; ++iteration) {
+        if (isCanceled())
+            break;
+
+        if (snapshotDue(iteration))
+            publishSnapshot(positions());
+
+        cellHeads.clear();
+
+        for (int row = 0; row < count; ++row) {
+            const QPair<int, int> cell(qFloor(_x.at(row) / STRESS_SHAPE_MIN_DISTANCE),
+                                       qFloor(_y.at(row) / STRESS_SHAPE_MIN_DISTANCE));
+
+            nextInCell[row] = cellHeads.value(cell, -1);
+            cellHeads.insert(cell, row);
+        }
+
+        qreal longestMove = 0.0;
+
+        for (int row = 0; row < count; ++row) {
+            const qreal x = _x.at(row);
+            const qreal y = _y.at(row);
+            const qreal angle = row * GOLDEN_ANGLE;
+            qreal sumX = 0.0, sumY = 0.0, weights = 0.0;
+
+            for (int i = _neighbourOffsets.at(row); i < _neighbourOffsets.at(row + 1); ++i) {
+                const int neighbour = _neighbours.at(i);
+
+                addStressTerm(x, y, _x.at(neighbour), _y.at(neighbour), 1.0, 1.0, angle, sumX, sumY, weights);
+            }
+
+            for (int pivot = 0; pivot < pivots; ++pivot) {
+                const int pivotRow = _pivots.at(pivot);
+                const qreal pivotDistance = distance(pivot, row);
+
+                if (pivotRow != row) {
+                    addStressTerm(x, y, _x.at(pivotRow), _y.at(pivotRow), pivotDistance,
+                                  _regionSizes.at(pivot) / (pivotDistance * pivotDistance), angle, sumX, sumY, weights);
+                }
+            }
+
+            // Being too close counts as much as all the other terms together
+            const qreal closeWeight = qMax(weights, 1.0);
+            const int cellX = qFloor(x / STRESS_SHAPE_MIN_DISTANCE);
+            const int cellY = qFloor(y / STRESS_SHAPE_MIN_DISTANCE);
+            int closeNodes = 0;
+
+            for (int gridX = cellX - 1; gridX <= cellX + 1; ++gridX) {
+                for (int gridY = cellY - 1; gridY <= cellY + 1; ++gridY) {
+                    for (int other = cellHeads.value(qMakePair(gridX, gridY), -1); other >= 0 && closeNodes < STRESS_SHAPE_MAX_CLOSE_NODES;
+                         other = nextInCell.at(other)) {
+                        const qreal dx = x - _x.at(other);
+                        const qreal dy = y - _y.at(other);
+
+                        if (other != row && dx * dx + dy * dy < STRESS_SHAPE_MIN_DISTANCE * STRESS_SHAPE_MIN_DISTANCE) {
+                            addStressTerm(x, y, _x.at(other), _y.at(other), STRESS_SHAPE_MIN_DISTANCE, closeWeight, angle,
+                                          sumX, sumY, weights);
+                            ++closeNodes;
+                        }
+                    }
+                }
+            }
+
+            if (weights > 0.0) {
+                _x[row] = sumX / weights;
+                _y[row] = sumY / weights;
+                longestMove = qMax(longestMove, qSqrt((_x.at(row) - x) * (_x.at(row) - x) + (_y.at(row) - y) * (_y.at(row) - y)));
+            }
+        }
+
+        if (longestMove < STRESS_SHAPE_CONVERGENCE)
+            break;
+    }
+}
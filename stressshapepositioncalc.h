@@ -0,0 +1,58 @@
+/*
+ * stressshapepositioncalc.h
+ *
+ * This class calculates the position of the nodes to be represented graphically in the view,
+ * so that the distance between two nodes in the map reflects the number of edges between
+ * them in the graph:
+ *
+ *  1. A number of pivot nodes are picked, spread evenly over the node list, and the distance
+ *     in edges from each of them to all nodes is found by a breadth-first search. The
+ *     searches are run in parallel.
+ *  2. The nodes are placed by classical multidimensional scaling (MDS) of the distances to
+ *     the pivots (Pivot MDS, Brandes and Pich), in O(k(V+E)) for k pivots.
+ *  3. The placement is refined by sparse stress majorization: each node is moved to where its
+ *     distances to its neighbours and to the pivots fit their distances in the graph best, a
+ *     pivot counting for the nodes closest to it. Nodes closer to each other than a minimum
+ *     distance are moved apart as well, since nodes at the same distance from all pivots
+ *     (e.g. the leaves of the same node) would otherwise end up at the same spot.
+ *
+ * All steps are deterministic, the same graph always gives the same layout. The majorization
+ * publishes the positions so far every few iterations, see AbstractNodeItemPositionCalc.
+ */
+
+#ifndef STRESSSHAPEPOSITIONCALC_H
+#define STRESSSHAPEPOSITIONCALC_H
+
+#include "abstractnodeitempositioncalc.h"
+#include <QVector>
+
+class StressShapePositionCalc : public AbstractNodeItemPositionCalc
+{
+public:
+    StressShapePositionCalc();
+
+    virtual void calculate();
+
+private:
+    QVector<int> _neighbourOffsets;     // The rows of the connected nodes of each node, CSR style
+    QVector<int> _neighbours;
+    QVector<int> _pivots;               // The rows of the pivot nodes
+    QVector<int> _distances;            // The distance from each pivot to each node, pivot by pivot
+    QVector<int> _regionSizes;          // The number of nodes closest to each pivot
+    QVector<qreal> _x;                  // The positions by row, in edges
+    QVector<qreal> _y;
+
+    void stressShape();
+    QVector<QPoint> positions() const;
+    void choosePivots();
+    void measureDistances();
+    void runTask(int task);
+    void measureDistancesFrom(int pivot);
+    void pivotMds();
+    void majorizeStress();
+
+    int nodeCount() const { return _neighbourOffsets.size() - 1; }
+    int distance(int pivot, int row) const { return _distances.at(pivot * nodeCount() + row); }
+};
+
+#endif // STRESSSHAPEPOSITIONCALC_H
@@ -1,5 +1,9 @@
 #include "visnode.h"
+#include "directorywalker.h"
+#include "filenamequeue.h"
+#include "parsecache.h"
 #include <QFile>
+#include <QFileInfo>
 #include <QFileDialog>
 #include <QStringRef>
 #include <QStringList>
@@ -19,9 +23,10 @@ const QStringList VisNode::FILEEXT_CPP = QStringList() << "cpp" << "cc" << "c" <
  *  program to be used from both command line and desktop
  */
 VisNode::VisNode(QStringList& arguments)
-    : _fileNames(arguments)
+    : _fileNames(arguments), _jobs(1), _followIncludes(false), _watchFiles(false),
+      _directoryFileType(FILEEXT_CPP.first()), _layout("distr"), _layoutIterations(-1), _watcher(NULL)
 {
-    _model = new NodeItemModel(_nodelist);
+    _model = new NodeItemModel;
 
     if (!createParser()) {
         std::cerr << "Unknown or non-matching filetype(s) selected!" << std::endl;
@@ -35,10 +40,7 @@ VisNode::VisNode(QStringList& arguments)
  */
 VisNode::~VisNode()
 {
-    foreach (NodeItem* node, _nodelist) {
-        delete node;
-    }
-
+    delete _watcher;
     delete _view;
     delete _model;
     delete _parser;
@@ -55,32 +57,97 @@ void VisNode::run()
 {
     std::cout << "Parsing... ";
 
-    // Set the model as the parent of the nodes
-    _parser->nodeCreator()->setNodeObjectParent(_model);
+    // Queue the chosen files, and walk the directories for more on a thread of its own
+    // while the parsing goes on. The walker closes the queue when done.
+    FileNameQueue queue;
+
+    foreach (const QString& fileName, _fileNames) {
+        queue.enqueue(fileName);
+    }
+
+    // The files of the compilation databases are queued with the flags they're compiled with
+    foreach (const QString& database, _compileDatabases) {
+        CPPNodeParser* cppParser = dynamic_cast<CPPNodeParser*>(_parser);
+
+        if (cppParser == NULL || !cppParser->queueCompileDatabase(database, queue)) {
+            std::cout << "VisNode failed to read the compilation database " << qPrintable(database) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Reuse the results of the files that are unchanged since the last run, if a cache is given
+    ParseCache cache;
+
+    if (!_cacheFileName.isEmpty()) {
+        if (!cache.open(_cacheFileName))
+            std::cerr << "VisNode ignores the unreadable cache " << qPrintable(_cacheFileName) << std::endl;
+
+        _parser->setCache(&cache);
+    }
+
+    DirectoryWalker walker(_directories, _parsedExtensions, queue);
+    walker.setIncludePatterns(_includePatterns);
+    walker.setExcludePatterns(_excludePatterns);
+    walker.start();
 
     // Parse the chosen files (effectively creates the nodes)
-    if (!_parser->parseFiles(_fileNames)) {
+    bool parsed = _parser->parseFiles(queue);
+
+    walker.wait();
+    _parser->setCache(NULL);
+
+    if (!parsed) {
         std::cout << "VisNode failed during parsing of files" << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    if (!_cacheFileName.isEmpty() && !cache.save())
+        std::cerr << "VisNode failed to write the cache " << qPrintable(_cacheFileName) << std::endl;
+
+    // The model keeps the nodes in a graph of its own, the parsed nodes are freed all at once
+    _model->setNodes(_nodelist);
+    _nodelist.clear();
+    _nodeIndex.clear();
+    _nodeArena.clear();
+
     // When all nodes have been found and created, create the visual map of the node set
-    _model->recalculateNodePositions();
+    if (_layout == "force" || _layout == "multilevel") {
+        ForceShapePositionCalc* forceCalc = _layout == "force" ? new ForceShapePositionCalc
+                                                               : new MultilevelShapePositionCalc;
+
+        if (_layoutIterations >= 0)
+            forceCalc->setMaxIterations(_layoutIterations);
 
-    // Get the size of the visual map and translate the nodes' coordinates to work the view's coordinate system
-    QSize modelSize = _model->modelGeometricSize();
-    _model->moveNodePositions(QPoint(modelSize.width()/2, modelSize.height()/2));
+        _model->setPositionCalc(forceCalc);
+    }
+    else if (_layout == "layer") {
+        _model->setPositionCalc(new LayerShapePositionCalc);
+    }
+    else if (_layout == "stress") {
+        _model->setPositionCalc(new StressShapePositionCalc);
+    }
 
-    // Create the view and set the model and delegate to be used in the view
-    _view = new NodeView(modelSize);
+    // Create the view and set the model and delegate to be used in the view. Its size follows
+    // the visual map, which grows and moves while the positions are calculated.
+    _view = new NodeView(QSize());
     _view->setModel(_model);
     _view->setItemDelegate(new NodeItemDelegate);
+    QObject::connect(_model, SIGNAL(geometricSizeChanged(QSize)), _view, SLOT(setModelTargetSize(QSize)));
 
     std::cout << "done." << std::endl;
 
     //printNodelist();
 
+    // Show the view at once, and the nodes moving into place as the layout is calculated on
+    // a thread of its own. Escape in the view stops it where it is.
     _view->show();
+    _model->startLayout();
+
+    // Keep the view up to date with the files, parsing only the changed ones again
+    if (_watchFiles) {
+        _watcher = new FileWatcher(_parser, _model);
+        _watcher->watchParsedFiles();
+    }
 
 //    printNodelist();
 //    qDebug() << "Closing program as debug mode!";
@@ -89,19 +156,28 @@ void VisNode::run()
 
 
 /*
- *  Debug function which prints the current node list with parents and their position and children
+ *  Debug function which prints the current nodes of the model with their position and children
  */
 void VisNode::printNodelist()
 {
+    const NodeGraph& graph = _model->graph();
+
     std::cout << "--------------------------------------------------" << std::endl;
 
-    for (int i = 0; i < _nodelist.size(); ++i) {
-        std::cout << i << ": " << qPrintable(_nodelist.at(i)->name());
+    for (int i = 0; i < graph.nodeCount(); ++i) {
+        std::cout << i << ": " << qPrintable(graph.name(i));
 
-        std::cout << " (" << _nodelist.at(i)->position().x() << ", " << _nodelist.at(i)->position().y() << "): ";
+        std::cout << " (" << graph.position(i).x() << ", " << graph.position(i).y() << "): ";
 
-        for (int j = 0; j < _nodelist.at(i)->childCount(); ++j) {
-            std::cout << qPrintable(_nodelist.at(i)->child(j)->name()) << ", ";
+        for (int edge = graph.childBegin(i); edge < graph.childEnd(i); ++edge) {
+            const int multiplicity = graph.multiplicity(edge);
+
+            std::cout << qPrintable(graph.name(graph.childRow(edge)));
+
+            if (multiplicity > 1)
+                std::cout << " (x" << multiplicity << ")";      // Included more than once
+
+            std::cout << ", ";
         }
 
         std::cout << std::endl;
@@ -111,22 +187,168 @@ void VisNode::printNodelist()
 }
 
 
+/*
+ *  Reads the options among the command line arguments and removes them from
+ *  _fileNames, leaving only the program name and the files to parse.
+ *  Supported options:
+ *      --jobs N            Parse N files in parallel
+ *      --include PATTERN   Only parse the files in directories matching the glob pattern (repeatable)
+ *      --exclude PATTERN   Skip the files and directories matching the glob pattern (repeatable)
+ *      --type EXT          The type of files to parse in directories, if no files are given (default cpp)
+ *      -I DIR, -IDIR       Search for included C++ files in DIR
+ *      -isystem DIR        Search for included C++ files in the system directory DIR, after the -I ones
+ *      --follow            Parse the included C++ files found as well, giving all files the given ones depend on
+ *      --watch             Keep watching the parsed files, and update the view when they change
+ *      --cache FILE        Keep the parse results in FILE, and only parse the files changed since the last run
+ *      --compdb FILE       Parse the C++ files of a compilation database, with their own include paths and defines
+ *      --layout NAME       How to lay out the nodes: distr (default), force, multilevel, layer or stress
+ *      --iterations N      The largest number of iterations of the force (or coarsest multilevel) layout
+ *  Returns false if an option is malformed.
+ */
+bool VisNode::parseOptions()
+{
+    static const QStringList OPTIONS_WITH_VALUE = QStringList() << "--jobs" << "--include" << "--exclude" << "--type"
+                                                                << "-I" << "-isystem" << "--compdb" << "--cache"
+                                                                << "--layout" << "--iterations";
+
+    int i = 1;                  // Skip the program name
+
+    while (i < _fileNames.size()) {
+        const QString option = _fileNames.at(i);
+
+        // Include paths may also be attached to the option, like the compiler's (e.g. -Iinclude)
+        if (option.startsWith("-isystem") && option.length() > 8) {
+            _systemIncludePaths.append(option.mid(8));
+            _fileNames.removeAt(i);
+            continue;
+        }
+        if (option.startsWith("-I") && option.length() > 2) {
+            _includePaths.append(option.mid(2));
+            _fileNames.removeAt(i);
+            continue;
+        }
+
+        if (option == "--follow") {
+            _followIncludes = true;
+            _fileNames.removeAt(i);
+            continue;
+        }
+
+        if (option == "--watch") {
+            _watchFiles = true;
+            _fileNames.removeAt(i);
+            continue;
+        }
+
+        if (!OPTIONS_WITH_VALUE.contains(option)) {
+            ++i;
+            continue;
+        }
+
+        if (i + 1 >= _fileNames.size()) {
+            std::cerr << "VisNode::parseOptions(): " << qPrintable(option) << " needs a value" << std::endl;
+            return false;
+        }
+
+        const QString value = _fileNames.at(i + 1);
+        _fileNames.removeAt(i);             // Remove the option...
+        _fileNames.removeAt(i);             // ... and its value
+
+        if (option == "--jobs") {
+            bool isNumber = false;
+            int jobs = value.toInt(&isNumber);
+
+            if (!isNumber || jobs < 1) {
+                std::cerr << "VisNode::parseOptions(): --jobs needs a positive number of jobs" << std::endl;
+                return false;
+            }
+
+            _jobs = jobs;
+        }
+        else if (option == "--include") {
+            _includePatterns.append(value);
+        }
+        else if (option == "--exclude") {
+            _excludePatterns.append(value);
+        }
+        else if (option == "-I") {
+            _includePaths.append(value);
+        }
+        else if (option == "-isystem") {
+            _systemIncludePaths.append(value);
+        }
+        else if (option == "--compdb") {
+            _compileDatabases.append(value);
+        }
+        else if (option == "--cache") {
+            _cacheFileName = value;
+        }
+        else if (option == "--layout") {
+            if (value != "distr" && value != "force" && value != "multilevel" && value != "layer" && value != "stress") {
+                std::cerr << "VisNode::parseOptions(): --layout needs distr, force, multilevel, layer or stress" << std::endl;
+                return false;
+            }
+
+            _layout = value;
+        }
+        else if (option == "--iterations") {
+            bool isNumber = false;
+            int iterations = value.toInt(&isNumber);
+
+            if (!isNumber || iterations < 0) {
+                std::cerr << "VisNode::parseOptions(): --iterations needs a number of iterations" << std::endl;
+                return false;
+            }
+
+            _layoutIterations = iterations;
+        }
+        else if (option == "--type") {
+            if (value.compare(FILEEXT_XML, Qt::CaseInsensitive) != 0 && !FILEEXT_CPP.contains(value, Qt::CaseInsensitive)) {
+                std::cerr << "VisNode::parseOptions(): --type needs a supported file type" << std::endl;
+                return false;
+            }
+
+            _directoryFileType = value;
+        }
+    }
+
+    return true;
+}
+
+
 /*
  *  Creates a parser based on the files provided
  *  (by command line arguments or file dialog).
+ *  If only directories are provided, the type set with --type decides the parser.
+ *  Compilation databases (compile_commands.json) always need a CPPNodeParser.
  *  If a parser can be created, true is returned. Otherwise, false.
  */
 bool VisNode::createParser()
 {
-    // If additional files was added through command line arguments
-    if (_fileNames.size() > 1) {
-        // If all files in the current directory should be parsed
-        if (_fileNames.at(1) == ".") {
-            // TODO Implement add all files in directory
-        }
+    if (!parseOptions())
+        return false;
 
+    // If additional files was added through command line arguments
+    if (_fileNames.size() > 1 || !_compileDatabases.isEmpty()) {
         // Remove the program name from the arguments list
         _fileNames.removeFirst();
+
+        // Separate the directories (e.g. ".") and compilation databases from the files,
+        // they are walked and read for files in run()
+        QStringList files;
+
+        foreach (const QString& fileName, _fileNames) {
+            const QFileInfo fileInfo(fileName);
+
+            if (fileInfo.isDir())
+                _directories.append(fileName);
+            else if (fileInfo.fileName() == "compile_commands.json")
+                _compileDatabases.append(fileName);
+            else
+                files.append(fileName);
+        }
+
+        _fileNames = files;
     }
     // Else, show a file selection dialog
     else {
@@ -137,24 +359,47 @@ bool VisNode::createParser()
                                                    QObject::tr("XML files (*.xml);;C++ files (*.cpp *.cc *.c *.cxx *.h *.hpp)"));
     }
 
-    if (filesOK() && !_fileNames.isEmpty()) {
+    if (filesOK() && (!_fileNames.isEmpty() || !_directories.isEmpty() || !_compileDatabases.isEmpty())) {
         // As the file types are already validated, get an arbitrary file's extension
-        QString filetype = getFileExtension(_fileNames.at(0));
+        QString filetype = _fileNames.isEmpty() ? _directoryFileType : getFileExtension(_fileNames.at(0));
+
+        if (_fileNames.isEmpty() && !_compileDatabases.isEmpty())
+            filetype = FILEEXT_CPP.first();
 
-        // Determine the type of parser to create
+        // Determine the type of parser to create, and the type of files to look for in the directories
         if (FILEEXT_XML.contains(filetype, Qt::CaseInsensitive)) {
+            if (!_compileDatabases.isEmpty()) {
+                std::cerr << "VisNode::createParser(): compilation databases can't be combined with XML files" << std::endl;
+                return false;
+            }
+
             qDebug() << "VisNode::createParser() constructed an XMLNodeParser";
-            _parser = new XMLNodeParser(_nodelist);
+            _parser = new XMLNodeParser(_nodelist, _nodeIndex, _nodeArena);
+            _parsedExtensions = QStringList() << FILEEXT_XML;
         }
         else if (FILEEXT_CPP.contains(filetype, Qt::CaseInsensitive)) {
             qDebug() << "VisNode::createParser() constructed a CPPNodeParser";
-            _parser = new CPPNodeParser(_nodelist);
+            CPPNodeParser* cppParser = new CPPNodeParser(_nodelist, _nodeIndex, _nodeArena);
+
+            foreach (const QString& path, _includePaths) {
+                cppParser->addIncludePath(path);
+            }
+            foreach (const QString& path, _systemIncludePaths) {
+                cppParser->addSystemIncludePath(path);
+            }
+
+            _parser = cppParser;
+            _parsedExtensions = FILEEXT_CPP;
         }
         else {
             std::cerr << "VisNode::createParser() found a non-supported file type" << std::endl;
             return false;
         }
 
+        _parser->setJobCount(_jobs);
+        _parser->setFollowFoundFiles(_followIncludes);
+        _parser->setRecordParsedFiles(_watchFiles);
+
         return true;
     }
 
@@ -14,12 +14,15 @@
 #define VISNODE_H
 
 #include "nodeitem.h"
+#include "nodeindex.h"
+#include "nodearena.h"
 #include "abstractnodeparser.h"
 #include "xmlnodeparser.h"
 #include "cppnodeparser.h"
 #include "nodeitemmodel.h"
 #include "nodeitemdelegate.h"
 #include "nodeview.h"
+#include "filewatcher.h"
 #include <cstdlib>              // exit()
 #include <iostream>             // cout, cerr, endl
 #include <QApplication>         // qApp - needed?
@@ -41,17 +44,35 @@ public:
     void printNodelist();
 
 private:
+    bool parseOptions();
     bool createParser();
     bool filesOK() const;
     bool fileExtensionsOK() const;
     const QString getFileExtension(const QString& fileName) const;
 
     QStringList _fileNames;
+    QStringList _directories;
+    QStringList _compileDatabases;
+    QStringList _includePatterns;
+    QStringList _excludePatterns;
+    QStringList _parsedExtensions;
+    QStringList _includePaths;
+    QStringList _systemIncludePaths;
+    NodeArena _nodeArena;                   // Owns the nodes of the node list, while parsing
     QList<NodeItem*> _nodelist;
+    NodeIndex _nodeIndex;
+    int _jobs;
+    bool _followIncludes;
+    bool _watchFiles;
+    QString _directoryFileType;
+    QString _cacheFileName;
+    QString _layout;
+    int _layoutIterations;
 
     AbstractNodeParser* _parser;
     NodeItemModel* _model;
     QAbstractItemView* _view;
+    FileWatcher* _watcher;
 
     static const QString FILEEXT_XML;
     static const QStringList FILEEXT_CPP;
@@ -8,8 +8,8 @@ static const int COLOR_CHANGE_STEP = 30;
 /*
  *  Constructor
  */
-XMLNodeParser::XMLNodeParser(QList<NodeItem*>& nodeList)
-    : AbstractNodeParser(nodeList)
+XMLNodeParser::XMLNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena)
+    : AbstractNodeParser(nodeList, nodeIndex, nodeArena)
 {
 }
 
@@ -22,10 +22,19 @@ XMLNodeParser::~XMLNodeParser()
 }
 
 
+/*
+ *  Creates a parser of the same kind, used to parse files on worker threads
+ */
+AbstractNodeParser* XMLNodeParser::createWorkerParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena) const
+{
+    return new XMLNodeParser(nodeList, nodeIndex, nodeArena);
+}
+
+
 /*
  *  Processes the file, going through its 'tokens',
  *  creating nodes when new ones are found.
- *  Currently just returns true...
+ *  Returns false if the XML is malformed.
  */
 bool XMLNodeParser::processFile(QFile& file)
 {
@@ -33,98 +42,97 @@ bool XMLNodeParser::processFile(QFile& file)
 
     _currentColor = START_COLOR;
 
-    nextNode();
+    readNodes();
+
+    if (_reader.hasError()) {
+        std::cerr << "XMLNodeParser::processFile(): " << qPrintable(file.fileName()) << ", line "
+                  << _reader.lineNumber() << ": " << qPrintable(_reader.errorString()) << std::endl;
+        return false;
+    }
 
     return true;
 }
 
 
 /*
- *  Recursive function that checks for the next start element.
- *  When such is found, it tries to create a node and then calls itself again,
- *  using the node just found as the current parent.
- *  Continues until the end of the document.
+ *  Goes through the start and end elements of the root element, creating a node for each start
+ *  element found, with the element it's in as the parent.
+ *  The elements we're in are kept on a stack of interned name ids (see NameTable), instead of
+ *  calling the function recursively, so any depth of nesting is handled. The stack is popped
+ *  on the end elements, whose names aren't even looked at.
  */
-void XMLNodeParser::nextNode(QString parentName)
+void XMLNodeParser::readNodes()
 {
-    QString currentName;
-
-    do {
-        _reader.readNext();                                     // Make sure we move (at least) one additional token forward
-
-        while (!(_reader.isStartElement() || _reader.isEndElement()))   // We're only interested in start and end elements
-            _reader.readNext();
-
-        currentName = _reader.name().toString();                // Save the name of the current element to separate it from
-                                                                // _reader, and for ease of use of the string
-
-        if (_reader.isStartElement()) {                         // Is the reader at a start element?
+    QVector<quint32> parentIds;                                     // The elements we're in, innermost last
 
-            //qDebug() << "name:" << currentName << "_currentColor:" << _currentColor;
+    while (!_reader.atEnd()) {
+        _reader.readNext();
 
-            _nodeCreator->createNode(currentName, parentName, _currentColor);
+        if (_reader.isStartElement()) {
+            const quint32 id = NameTable::intern(_reader.name().toString());
 
-            //qDebug() << "<" << qPrintable(currentName) << " (parent = " << qPrintable(parentName) << ")>";
+            if (parentIds.isEmpty())                            // The root element has no parent
+                _nodeCreator->createStandAloneNode(id, _currentColor);
+            else
+                _nodeCreator->createNode(id, parentIds.last(), _currentColor);
 
-            changeHsvHue(COLOR_CHANGE_STEP);                   // Modify color before going further recursively
-
-            nextNode(currentName);                              // Recursive call on this function for the new level
-
-            changeHsvHue(-COLOR_CHANGE_STEP);                    // Restore color after coming back from the recursive call
+            changeHsvHue(COLOR_CHANGE_STEP);                    // Modify color for the elements inside this one
+            parentIds.append(id);
         }
+        else if (_reader.isEndElement()) {
+            changeHsvHue(-COLOR_CHANGE_STEP);                   // Restore color when leaving the element
+            parentIds.removeLast();
 
-    } while (currentName != parentName && !parentName.isEmpty() && !_reader.atEnd());
-    // The while-conditions work by checking:
-    // 1) If the closing tag of the current started one is found
-    // 2) If the "above root" (=no name, doesn't exist) element is found
-    // 3) If the reader is at the end
-    // Testing showed all three were needed to parse successfully
+            if (parentIds.isEmpty())                            // The root element is done
+                break;
+        }
+    }
 }
 
+
 /*
  *  Prints the XML hierarchy (startElement and stopElement only) with indentation.
  *  Mainly a debugging feature to verify the structure of what we are interested
  *  to find when creating the nodes.
- *  Used in the same way as nextNode(), function calls could be used more or less interchangeably.
+ *  Used in the same way as readNodes(), function calls could be used more or less interchangeably.
+ *  Like readNodes(), it goes through the elements without recursion, keeping only the depth.
  */
-void XMLNodeParser::printNodeRecursive(QString parentName, int indent)
+void XMLNodeParser::printNodeTree()
 {
-    QString currentName;
-    bool endSection = false;                                    // Set to true if we enter a subsection with 1+ start elements
-
-    do {
-        _reader.readNext();                                     // Make sure we move (at least) one additional token forward
+    int depth = 0;
+    bool hasChildren = false;                                   // If the last element printed has elements inside it
 
-        while (!(_reader.isStartElement() || _reader.isEndElement()))   // We're only interested in start and end elements
-            _reader.readNext();
-
-        currentName = _reader.name().toString();                // Save the name of the current element to separate it from
-                                                                // _reader, and for ease of use of the string
-        if (_reader.isStartElement()) {                         // START ELEMENT?
-            endSection = true;                                  // This section will need to be closed later (see else clause)
+    while (!_reader.atEnd()) {
+        _reader.readNext();
 
+        if (_reader.isStartElement()) {
             std::cout << std::endl;                             // Break the line...
 
-            for (int i = 0; i < indent; i++)                    // ... and indent to correct level
+            for (int i = 0; i < depth; i++)                     // ... and indent to correct level
                 std::cout << "  ";
 
-            std::cout << "<" << qPrintable(currentName) << ">";     // Print the start tag
+            std::cout << "<" << qPrintable(_reader.name().toString()) << ">";   // Print the start tag
 
-            indent++;                                           // Increase the indent for the next element
-            printNodeRecursive(currentName, indent);            // Recursive call on this function for the new level
-            indent--;                                           // When returning, decrease indent to prior level
+            hasChildren = false;
+            depth++;
         }
-        else {                                                  // NOT START ELEMENT == STOP ELEMENT
-            if (endSection) {                                   // If this instance of the function (not a recursive one)
-                std::cout << std::endl;                         // has been run and found a startElement, it needs to be
-                for (int i = 0; i < (indent-1); i++)            // "closed" in a good looking way. This ensures correct
-                    std::cout << "  ";                          // linebreak and indentation.
+        else if (_reader.isEndElement()) {
+            depth--;
+
+            if (hasChildren) {                                  // Elements with elements inside them are closed on
+                std::cout << std::endl;                         // a line of their own, with the same indentation
+                for (int i = 0; i < depth; i++)                 // as their start tag
+                    std::cout << "  ";
             }
 
-            std::cout << "</" << qPrintable(currentName) << ">";    // Print the end tag
-        }
+            std::cout << "</" << qPrintable(_reader.name().toString()) << ">";  // Print the end tag
 
-    } while (currentName != parentName && !_reader.atEnd() && parentName != "null");
+            hasChildren = true;                                 // The enclosing element has this one inside it
+
+            if (depth == 0)
+                break;
+        }
+    }
 }
 
 /*
@@ -12,6 +12,7 @@
 #include "abstractnodeparser.h"
 #include <iostream>
 #include <QList>
+#include <QVector>
 #include <QXmlStreamReader>
 
 class QFile;
@@ -20,18 +21,18 @@ class NodeItem;
 class XMLNodeParser : public AbstractNodeParser
 {
 public:
-    XMLNodeParser(QList<NodeItem*>& nodeList);
+    XMLNodeParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena);
     virtual ~XMLNodeParser();
 
 protected:
     bool processFile(QFile& file);
-    void nextNode(QString parentName = QString());
+    AbstractNodeParser* createWorkerParser(QList<NodeItem*>& nodeList, NodeIndex& nodeIndex, NodeArena& nodeArena) const;
+    void readNodes();
 
 private:
     QXmlStreamReader _reader;
     QColor _currentColor;
-
-    void printNodeRecursive(QString parentName, int indent = 0);
+    void printNodeTree();
     void changeHsvHue(int increaseHueWith);
 };
 